@@ -0,0 +1,203 @@
+/*
+ * Result cache.
+ *
+ * Results are kept in a memory mapped open addressing hash table,
+ * keyed by a hash of the input and a hash of the configuration (the
+ * command line, the program and any images given with -I).  Only the
+ * parent testAfl process touches the table, and the file is locked
+ * while it is open so separate runs don't trip over each other.  The
+ * table doubles in place when it gets half full.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "tafl.h"
+
+#define CACHEMAGIC 0x31686374 /* "tch1" */
+#define MINSLOTS 4096
+
+struct cacheHdr {
+    u_int32_t magic;
+    u_int32_t nslots;
+    u_int32_t nused;
+    u_int32_t pad;
+};
+
+struct cacheEnt {
+    u_int64_t input;        /* 0 if the slot is free */
+    u_int64_t cfg;
+    u_int32_t status;
+    u_int32_t edges;
+    u_int32_t usec;
+    u_int32_t timedOut;
+};
+
+static int cacheFd = -1;
+static struct cacheHdr *hdr;
+static struct cacheEnt *ents;
+
+/* 64-bit FNV-1a */
+u_int64_t
+hashBytes(u_int64_t h, void *p, size_t n)
+{
+    unsigned char *b = p;
+
+    if(h == 0)
+        h = 0xcbf29ce484222325ULL;
+    while(n--) {
+        h ^= *b++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* hash a file's contents into h, returning 0 if it can't be read */
+u_int64_t
+hashFile(u_int64_t h, char *fn)
+{
+    unsigned char buf[65536];
+    size_t n;
+    FILE *fp;
+
+    fp = fopen(fn, "r");
+    if(!fp)
+        return 0;
+    while((n = fread(buf, 1, sizeof buf, fp)) > 0)
+        h = hashBytes(h, buf, n);
+    fclose(fp);
+    return h ? h : 1;
+}
+
+static size_t
+tableSize(u_int32_t nslots)
+{
+    return sizeof *hdr + (size_t)nslots * sizeof ents[0];
+}
+
+static void
+mapTable(size_t sz)
+{
+    hdr = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, cacheFd, 0);
+    xperror(hdr == MAP_FAILED, "mmap cache");
+    ents = (struct cacheEnt *)(hdr + 1);
+}
+
+static struct cacheEnt *
+findSlot(u_int64_t input, u_int64_t cfg)
+{
+    u_int32_t i, mask = hdr->nslots - 1;
+
+    for(i = (input ^ (cfg * 0x9e3779b97f4a7c15ULL)) & mask; ; i = (i + 1) & mask) {
+        if(ents[i].input == 0 || (ents[i].input == input && ents[i].cfg == cfg))
+            return &ents[i];
+    }
+}
+
+/* double the table in place and put the entries back */
+static void
+growTable(void)
+{
+    struct cacheEnt *old, *e;
+    u_int32_t i, n;
+
+    n = hdr->nslots;
+    old = malloc(n * sizeof old[0]);
+    xperror(!old, "malloc");
+    memcpy(old, ents, n * sizeof old[0]);
+    munmap(hdr, tableSize(n));
+    xperror(ftruncate(cacheFd, tableSize(n * 2)) == -1, "ftruncate cache");
+    mapTable(tableSize(n * 2));
+    memset(ents, 0, n * 2 * sizeof ents[0]);
+    hdr->nslots = n * 2;
+    for(i = 0; i < n; i++) {
+        if(old[i].input) {
+            e = findSlot(old[i].input, old[i].cfg);
+            *e = old[i];
+        }
+    }
+    free(old);
+}
+
+void
+cacheOpen(char *fn)
+{
+    struct stat st;
+
+    cacheFd = open(fn, O_RDWR | O_CREAT, 0644);
+    xperror(cacheFd == -1, fn);
+    xperror(flock(cacheFd, LOCK_EX) == -1, "flock");
+    xperror(fstat(cacheFd, &st) == -1, fn);
+    if(st.st_size == 0) {
+        xperror(ftruncate(cacheFd, tableSize(MINSLOTS)) == -1, "ftruncate cache");
+        mapTable(tableSize(MINSLOTS));
+        hdr->magic = CACHEMAGIC;
+        hdr->nslots = MINSLOTS;
+        return;
+    }
+    if(st.st_size < sizeof *hdr) {
+        fprintf(stderr, "%s: not a result cache\n", fn);
+        exit(1);
+    }
+    mapTable(st.st_size);
+    if(hdr->magic != CACHEMAGIC || hdr->nslots < MINSLOTS || (hdr->nslots & (hdr->nslots - 1))
+    || tableSize(hdr->nslots) != st.st_size) {
+        fprintf(stderr, "%s: not a result cache\n", fn);
+        exit(1);
+    }
+}
+
+/* look up a result, returning 0 if it isn't cached */
+int
+cacheGet(u_int64_t input, u_int64_t cfg, struct result *r)
+{
+    struct cacheEnt *e;
+
+    e = findSlot(input, cfg);
+    if(e->input == 0)
+        return 0;
+    r->status = e->status;
+    r->edges = e->edges;
+    r->secs = e->usec / 1000000.0;
+    r->timedOut = e->timedOut;
+    r->vm = -1;
+    r->cached = 1;
+    return 1;
+}
+
+void
+cachePut(u_int64_t input, u_int64_t cfg, struct result *r)
+{
+    struct cacheEnt *e;
+
+    e = findSlot(input, cfg);
+    if(e->input == 0) {
+        if((hdr->nused + 1) * 2 > hdr->nslots) {
+            growTable();
+            e = findSlot(input, cfg);
+        }
+        hdr->nused++;
+    }
+    e->input = input;
+    e->cfg = cfg;
+    e->status = r->status;
+    e->edges = r->edges;
+    e->usec = r->secs * 1000000;
+    e->timedOut = r->timedOut;
+}
+
+void
+cacheClose(void)
+{
+    munmap(hdr, tableSize(hdr->nslots));
+    close(cacheFd);
+    cacheFd = -1;
+}
@@ -0,0 +1,280 @@
+/*
+ * Minimize a corpus using the coverage archive written by testAfl -C.
+ *
+ * Each edge and hit count bucket is a tuple.  Like afl-cmin, every
+ * tuple is given to the cheapest input that has it (cost is file size
+ * times run time), and then, rarest tuples first, the owner of each
+ * tuple not yet covered is kept and all of its tuples are marked as
+ * covered.  Inputs that didn't exit normally are dropped unless -a
+ * is given.  If an input is in the archive more than once, its last
+ * record is used.  All the archives must use the same map size.
+ *
+ * gcc -g -Wall cmin.c vm.c cov.c -o cminAfl
+ * ./cminAfl [-a] [-n] -o outdir archive ...
+ */
+
+#include <errno.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tafl.h"
+
+struct input {
+    char *name;
+    u_int32_t *ents;
+    int nents;
+    int status;
+    long usec;
+    long size;
+    int order;              /* position in the archives */
+    int keep;
+};
+
+static struct input *ins;
+static int nins, maxins;
+
+static size_t ntuples;      /* map size * NBUCKETS */
+static int *tupleCount;
+static int *tupleOwner;
+static unsigned char *covered;
+
+static void
+usage(char *prog)
+{
+    printf("usage:  %s [-a] [-n] -o outdir archive ...\n", prog);
+    printf("\t\t-a\tkeep inputs that crashed or were killed\n");
+    printf("\t\t-n\tdon't copy anything, just report\n");
+    printf("\t\t-o dir\twrite the minimized corpus to dir\n");
+    exit(1);
+}
+
+static void
+loadArchive(char *fn)
+{
+    struct covRec h;
+    struct input *in;
+    u_int32_t *ents;
+    char *name;
+    FILE *fp;
+    int x;
+
+    fp = fopen(fn, "r");
+    xperror(!fp, fn);
+    while((x = covNext(fp, &h, &name, &ents)) == 1) {
+        if(!ntuples)
+            ntuples = (size_t)h.mapSize * NBUCKETS;
+        if(ntuples != (size_t)h.mapSize * NBUCKETS) {
+            fprintf(stderr, "%s: map size %d doesn't match the earlier records\n", fn, h.mapSize);
+            exit(1);
+        }
+        if(nins == maxins) {
+            maxins = maxins ? maxins * 2 : 1024;
+            ins = realloc(ins, maxins * sizeof ins[0]);
+            xperror(!ins, "realloc");
+        }
+        in = &ins[nins];
+        memset(in, 0, sizeof *in);
+        in->name = strdup(name);
+        in->ents = malloc(h.nedges * sizeof ents[0] + 1);
+        xperror(!in->name || !in->ents, "malloc");
+        memcpy(in->ents, ents, h.nedges * sizeof ents[0]);
+        in->nents = h.nedges;
+        in->status = h.status;
+        in->usec = h.usec;
+        in->order = nins++;
+    }
+    if(x == -1) {
+        fprintf(stderr, "%s: corrupt record after %d inputs\n", fn, nins);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+static int
+cmpName(const void *a, const void *b)
+{
+    const struct input *x = a, *y = b;
+    int c;
+
+    c = strcmp(x->name, y->name);
+    return c ? c : x->order - y->order;
+}
+
+static int
+cmpCost(const void *a, const void *b)
+{
+    const struct input *x = a, *y = b;
+    double cx, cy;
+
+    /* +1 so empty files and sub-microsecond runs still compare */
+    cx = (double)(x->size + 1) * (x->usec + 1);
+    cy = (double)(y->size + 1) * (y->usec + 1);
+    if(cx != cy)
+        return cx < cy ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+static int *rareTuples;
+
+static int
+cmpRare(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    if(tupleCount[x] != tupleCount[y])
+        return tupleCount[x] - tupleCount[y];
+    return x - y;
+}
+
+/* drop stale duplicates, missing files and (unless keepAll) crashes */
+static void
+pruneInputs(int keepAll)
+{
+    struct stat st;
+    int i, n, nstale = 0, nmissing = 0, ncrash = 0;
+
+    qsort(ins, nins, sizeof ins[0], cmpName);
+    for(i = n = 0; i < nins; i++) {
+        if(i + 1 < nins && strcmp(ins[i].name, ins[i + 1].name) == 0) {
+            nstale++;
+        } else if(stat(ins[i].name, &st) == -1) {
+            nmissing++;
+        } else if(!keepAll && !WIFEXITED(ins[i].status)) {
+            ncrash++;
+        } else {
+            ins[i].size = st.st_size;
+            ins[n++] = ins[i];
+            continue;
+        }
+        free(ins[i].name);
+        free(ins[i].ents);
+    }
+    nins = n;
+    if(nstale)
+        printf("%d stale records\n", nstale);
+    if(nmissing)
+        printf("%d inputs missing\n", nmissing);
+    if(ncrash)
+        printf("%d inputs crashed or were killed\n", ncrash);
+}
+
+static void
+minimize(void)
+{
+    int i, j, k, t, nhit;
+
+    tupleCount = calloc(ntuples, sizeof tupleCount[0]);
+    tupleOwner = malloc(ntuples * sizeof tupleOwner[0]);
+    covered = calloc(ntuples / 8, 1);
+    xperror(!tupleCount || !tupleOwner || !covered, "malloc");
+
+    qsort(ins, nins, sizeof ins[0], cmpCost);
+    for(t = 0; t < ntuples; t++)
+        tupleOwner[t] = -1;
+    for(i = 0; i < nins; i++) {
+        for(j = 0; j < ins[i].nents; j++) {
+            t = ins[i].ents[j];
+            if(tupleOwner[t] == -1)
+                tupleOwner[t] = i;
+            tupleCount[t]++;
+        }
+    }
+
+    rareTuples = malloc(ntuples * sizeof rareTuples[0]);
+    xperror(!rareTuples, "malloc");
+    for(t = nhit = 0; t < ntuples; t++) {
+        if(tupleCount[t])
+            rareTuples[nhit++] = t;
+    }
+    qsort(rareTuples, nhit, sizeof rareTuples[0], cmpRare);
+    printf("%d inputs, %d tuples\n", nins, nhit);
+
+    for(k = 0; k < nhit; k++) {
+        t = rareTuples[k];
+        if(covered[t >> 3] & (1 << (t & 7)))
+            continue;
+        i = tupleOwner[t];
+        ins[i].keep = 1;
+        for(j = 0; j < ins[i].nents; j++) {
+            t = ins[i].ents[j];
+            covered[t >> 3] |= 1 << (t & 7);
+        }
+    }
+    free(rareTuples);
+}
+
+/* link or copy an input into outdir under a name not yet used */
+static void
+emit(char *outdir, char *name)
+{
+    char fn[1024], *tmp, *base;
+    int n;
+
+    tmp = strdup(name);
+    xperror(!tmp, "strdup");
+    base = basename(tmp);
+    snprintf(fn, sizeof fn, "%s/%s", outdir, base);
+    for(n = 1; access(fn, F_OK) == 0; n++)
+        snprintf(fn, sizeof fn, "%s/%s,%d", outdir, base, n);
+    if(link(name, fn) == -1)
+        copyFile(fn, name);
+    free(tmp);
+}
+
+int main(int argc, char **argv)
+{
+    char *prog, *outdir = NULL;
+    long bytes, keptBytes;
+    int i, opt, kept, keepAll = 0, dryRun = 0;
+
+    prog = argv[0];
+    while((opt = getopt(argc, argv, "ano:")) != -1) {
+        switch(opt) {
+        case 'a':
+            keepAll = 1;
+            break;
+        case 'n':
+            dryRun = 1;
+            break;
+        case 'o':
+            outdir = optarg;
+            break;
+        default:
+            usage(prog);
+        }
+    }
+    argv += optind;
+    if(!argv[0] || (!outdir && !dryRun))
+        usage(prog);
+
+    for(i = 0; argv[i]; i++)
+        loadArchive(argv[i]);
+    pruneInputs(keepAll);
+    if(nins == 0) {
+        printf("No inputs to minimize!\n");
+        return 1;
+    }
+    minimize();
+
+    if(!dryRun && mkdir(outdir, 0755) == -1 && errno != EEXIST)
+        xperror(1, outdir);
+    bytes = keptBytes = 0;
+    for(i = kept = 0; i < nins; i++) {
+        bytes += ins[i].size;
+        if(!ins[i].keep)
+            continue;
+        kept++;
+        keptBytes += ins[i].size;
+        if(!dryRun)
+            emit(outdir, ins[i].name);
+    }
+    printf("kept %d of %d inputs, %ld of %ld bytes\n", kept, nins, keptBytes, bytes);
+    return 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * Coverage map analysis.
+ *
+ * Maps are mostly zero, so they are scanned 16 bytes at a time (with
+ * SSE2, or 8 with plain 64-bit words) and only the chunks that have
+ * hits are looked at byte by byte.  Hit counts are put in the same
+ * buckets afl-fuzz uses.
+ *
+ * The archive holds each input's coverage as a sparse list of
+ * idx << 3 | bucket entries after a struct covRec header and the
+ * input's name.  Records are appended with a single write so several
+ * workers can share one archive.
+ *
+ * A mask lists map entries (usually ones found to be unstable) to
+ * clear after every run, one per line, with # comments.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tafl.h"
+
+static u_int32_t *maskIdx;
+static size_t nmask;
+static unsigned char *maskBits;
+
+/* afl-fuzz's hit count buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+ */
+static unsigned char bucketOf[256];
+static int bucketsInited = 0;
+
+static void
+initBuckets(void)
+{
+    int i;
+
+    if(bucketsInited)
+        return;
+    bucketsInited = 1;
+    for(i = 1; i < 256; i++)
+        bucketOf[i] = i < 4 ? i - 1 : i < 8 ? 3 : i < 16 ? 4 : i < 32 ? 5 : i < 128 ? 6 : 7;
+}
+
+/* bitmask of the nonzero bytes in a chunk of the map */
+static inline unsigned int
+nonzero(unsigned char *p)
+{
+#ifdef __SSE2__
+    __m128i x = _mm_loadu_si128((__m128i *)p);
+    return ~_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) & 0xffff;
+#else
+    u_int64_t w;
+    unsigned int m = 0;
+    int i;
+
+    memcpy(&w, p, sizeof w);
+    if(w == 0)
+        return 0;
+    for(i = 0; i < 8; i++) {
+        if(p[i])
+            m |= 1 << i;
+    }
+    return m;
+#endif
+}
+
+#ifdef __SSE2__
+#define CHUNK 16
+#else
+#define CHUNK 8
+#endif
+
+/* count the edges hit, and if hist isn't NULL, how many fall in each bucket */
+int
+covCount(unsigned char *map, size_t sz, int *hist)
+{
+    unsigned int m;
+    size_t i;
+    int cnt = 0;
+
+    initBuckets();
+    if(hist)
+        memset(hist, 0, NBUCKETS * sizeof hist[0]);
+    for(i = 0; i < sz; i += CHUNK) {
+        m = nonzero(map + i);
+        if(!m)
+            continue;
+        cnt += __builtin_popcount(m);
+        if(!hist)
+            continue;
+        while(m) {
+            hist[bucketOf[map[i + __builtin_ctz(m)]]]++;
+            m &= m - 1;
+        }
+    }
+    return cnt;
+}
+
+/* list the edges hit as idx << 3 | bucket, returning how many */
+int
+covSparse(unsigned char *map, size_t sz, u_int32_t *ents)
+{
+    unsigned int m;
+    size_t i, j;
+    int n = 0;
+
+    initBuckets();
+    for(i = 0; i < sz; i += CHUNK) {
+        m = nonzero(map + i);
+        while(m) {
+            j = i + __builtin_ctz(m);
+            ents[n++] = (j << 3) | bucketOf[map[j]];
+            m &= m - 1;
+        }
+    }
+    return n;
+}
+
+/* set the bits for the edges hit in the bitmap seen, which may be shared */
+void
+covMerge(unsigned char *map, size_t sz, unsigned char *seen)
+{
+    unsigned int m;
+    size_t i, j;
+
+    for(i = 0; i < sz; i += CHUNK) {
+        m = nonzero(map + i);
+        while(m) {
+            j = i + __builtin_ctz(m);
+            if(!(seen[j >> 3] & (1 << (j & 7))))
+                __sync_fetch_and_or(&seen[j >> 3], 1 << (j & 7));
+            m &= m - 1;
+        }
+    }
+}
+
+/*
+ * List the entries whose hit count bucket differs between a and b,
+ * returning how many.  Masked entries are skipped, since children
+ * left running by one test can still write to them after covMask.
+ */
+int
+covDiff(unsigned char *a, unsigned char *b, size_t sz, u_int32_t *idx)
+{
+    unsigned int m;
+    size_t i, j;
+    int n = 0;
+
+    initBuckets();
+    for(i = 0; i < sz; i += CHUNK) {
+        m = nonzero(a + i) | nonzero(b + i);
+        while(m) {
+            j = i + __builtin_ctz(m);
+            if((!a[j] || !b[j] || bucketOf[a[j]] != bucketOf[b[j]])
+            && !(maskBits && (maskBits[j >> 3] & (1 << (j & 7)))))
+                idx[n++] = j;
+            m &= m - 1;
+        }
+    }
+    return n;
+}
+
+/* read a mask, returning -1 if it can't be read */
+int
+covLoadMask(char *fn, size_t sz)
+{
+    char line[256], *end;
+    unsigned long x;
+    size_t max = 0;
+    FILE *fp;
+
+    maskBits = calloc(sz / 8, 1);
+    fp = fopen(fn, "r");
+    if(!fp || !maskBits)
+        return -1;
+    while(fgets(line, sizeof line, fp)) {
+        x = strtoul(line, &end, 0);
+        if(end == line)
+            continue;
+        if(x >= sz) {
+            fprintf(stderr, "%s: entry %ld is outside the map\n", fn, x);
+            continue;
+        }
+        if(nmask == max) {
+            max = max ? max * 2 : 1024;
+            maskIdx = realloc(maskIdx, max * sizeof maskIdx[0]);
+            if(!maskIdx)
+                return -1;
+        }
+        maskIdx[nmask++] = x;
+        maskBits[x >> 3] |= 1 << (x & 7);
+    }
+    fclose(fp);
+    return 0;
+}
+
+void
+covMask(unsigned char *map)
+{
+    size_t i;
+
+    for(i = 0; i < nmask; i++)
+        map[maskIdx[i]] = 0;
+}
+
+/* append an input's coverage to the archive */
+int
+covSave(int fd, char *name, struct result *r, unsigned char *map, size_t sz)
+{
+    static unsigned char *buf;
+    static size_t bufsz;
+    struct covRec h;
+    size_t nlen, npad, need;
+
+    /* the name is NUL padded to keep the entries aligned */
+    nlen = strlen(name);
+    npad = (nlen + 4) & ~3;
+    need = sizeof h + npad + sz * sizeof(u_int32_t);
+    if(need > bufsz) {
+        free(buf);
+        buf = malloc(need);
+        bufsz = buf ? need : 0;
+        if(!buf)
+            return -1;
+    }
+    h.magic = COVMAGIC;
+    h.mapSize = sz;
+    h.nameLen = npad;
+    h.nedges = covSparse(map, sz, (u_int32_t *)(buf + sizeof h + npad));
+    h.status = r->status;
+    h.usec = r->secs * 1000000;
+    memcpy(buf, &h, sizeof h);
+    memset(buf + sizeof h, 0, npad);
+    memcpy(buf + sizeof h, name, nlen);
+    need = sizeof h + npad + h.nedges * sizeof(u_int32_t);
+    return write(fd, buf, need) == (ssize_t)need ? 0 : -1;
+}
+
+/*
+ * Read the next archive record.  The name and entries are kept in
+ * buffers that are reused by the next call.  Returns 0 at the end
+ * of the archive and -1 if it is corrupt.
+ */
+int
+covNext(FILE *fp, struct covRec *h, char **name, u_int32_t **ents)
+{
+    static char *nbuf;
+    static u_int32_t *ebuf;
+    static size_t nsz, esz;
+    u_int32_t i;
+
+    if(fread(h, sizeof *h, 1, fp) != 1)
+        return 0;
+    if(h->magic != COVMAGIC || h->mapSize > MAXMAP || h->nameLen > 65536 || h->nedges > h->mapSize)
+        return -1;
+    if(h->nameLen + 1 > nsz) {
+        nsz = h->nameLen + 1;
+        nbuf = realloc(nbuf, nsz);
+    }
+    if(h->nedges > esz) {
+        esz = h->nedges;
+        ebuf = realloc(ebuf, esz * sizeof ebuf[0]);
+    }
+    if(!nbuf || (h->nedges && !ebuf)
+    || fread(nbuf, 1, h->nameLen, fp) != h->nameLen
+    || fread(ebuf, sizeof ebuf[0], h->nedges, fp) != h->nedges)
+        return -1;
+    /* the entries are used as indexes, so don't trust them */
+    for(i = 0; i < h->nedges; i++) {
+        if(ebuf[i] >= h->mapSize * NBUCKETS)
+            return -1;
+    }
+    nbuf[h->nameLen] = 0;
+    *name = nbuf;
+    *ents = ebuf;
+    return 1;
+}
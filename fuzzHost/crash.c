@@ -0,0 +1,159 @@
+/*
+ * Crash signatures from the console.
+ *
+ * A crash's signature is its panic message (or the fault that led to
+ * it) with numbers and addresses replaced by N, followed by the first
+ * few functions ddb shows, if it got that far.  For example:
+ *
+ *   panic: mallocarray: overflow N * N
+ *   panic: kernel diagnostic assertion "x" failed: file "f.c", line 123 | knote_attach < kqueue_register
+ *
+ * Line numbers in assertion messages are kept since they name the
+ * assertion.  Inputs with the same signature are the same bug.
+ */
+
+#define _GNU_SOURCE /* memmem */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "tafl.h"
+
+#define MAXFRAMES 5
+
+/* frames that show up in every trace */
+static char *boringFrames[] = {
+    "db_enter", "db_ktrap", "Debugger", "panic", "__assert", "kassert",
+    "trap", "kerntrap", "kpageflttrap", "alltraps", "alltraps_kern",
+    "calltrap", "Xsyscall", "Xsyscall_untramp", "syscall", NULL,
+};
+
+#define wordChar(c) (isalnum((unsigned char)(c)) || (c) == '_')
+
+/*
+ * Length of the number at s, or 0 if there isn't one: a standalone
+ * word that is 0x hex, or hex digits including a decimal digit (so
+ * words like "bad" aren't numbers).
+ */
+static size_t
+numberLen(char *s, size_t n)
+{
+    size_t j = 0;
+    int digits = 0;
+
+    if(n > 2 && s[0] == '0' && s[1] == 'x') {
+        j = 2;
+        digits = 1;
+    }
+    for(; j < n && isxdigit((unsigned char)s[j]); j++)
+        digits |= isdigit((unsigned char)s[j]) != 0;
+    if(!digits || (j < n && wordChar(s[j])))
+        return 0;
+    return j;
+}
+
+/* append s to the signature, replacing numbers with N */
+static void
+addNormal(char *sig, size_t sz, char *s, size_t n)
+{
+    size_t len = strlen(sig), i = 0, j;
+
+    while(i < n && len + 2 < sz) {
+        if((i == 0 || !wordChar(s[i - 1])) && (j = numberLen(s + i, n - i)) != 0) {
+            if(i >= 5 && strncmp(s + i - 5, "line ", 5) == 0) {
+                while(j-- && len + 2 < sz)
+                    sig[len++] = s[i++];
+            } else {
+                sig[len++] = 'N';
+                i += j;
+            }
+            continue;
+        }
+        sig[len++] = s[i++];
+    }
+    sig[len] = 0;
+}
+
+static int
+boring(char *fn, size_t n)
+{
+    int i;
+
+    for(i = 0; boringFrames[i]; i++) {
+        if(strlen(boringFrames[i]) == n && strncmp(fn, boringFrames[i], n) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Find the signature in the console output log.  Returns 0, leaving
+ * sig empty, if there is no panic or fault message.
+ */
+int
+crashSig(char *log, size_t n, char *sig, size_t sz)
+{
+    char *p, *end, *nl, *msg = NULL, *fault = NULL, *at, *last = NULL;
+    size_t msgLen = 0, faultLen = 0, lastLen = 0;
+    int nframes = 0;
+
+    sig[0] = 0;
+    end = log + n;
+    /* the last panic, and the last fault message before it */
+    for(p = log; p < end; p = nl + 1) {
+        nl = memchr(p, '\n', end - p);
+        if(!nl)
+            nl = end;
+        if(nl - p > 7 && strncmp(p, "panic: ", 7) == 0) {
+            msg = p;
+            msgLen = nl - p;
+        } else if(!msg && ((nl - p > 10 && strncmp(p, "uvm_fault(", 10) == 0)
+        || (nl - p > 8 && strncmp(p, "kernel: ", 8) == 0))) {
+            fault = p;
+            faultLen = nl - p;
+        }
+    }
+    if(msg)
+        addNormal(sig, sz, msg, msgLen);
+    else if(fault)
+        addNormal(sig, sz, fault, faultLen);
+    else
+        return 0;
+    while(sig[0] && isspace((unsigned char)sig[strlen(sig) - 1]))
+        sig[strlen(sig) - 1] = 0;
+
+    /*
+     * ddb says "Stopped at func+0x1a: insn" and trace lines look like
+     * "func(args) at func+0x1a".
+     */
+    for(p = msg ? msg : fault; p < end && nframes < MAXFRAMES; p = nl + 1) {
+        nl = memchr(p, '\n', end - p);
+        if(!nl)
+            nl = end;
+        if(nl - p > 11 && strncmp(p, "Stopped at", 10) == 0) {
+            for(p += 10; p < nl && isspace((unsigned char)*p); p++)
+                continue;
+            at = memchr(p, '+', nl - p);
+        } else {
+            at = memchr(p, '(', nl - p);
+            if(at && !memmem(at, nl - at, ") at ", 5))
+                at = NULL;
+        }
+        if(!at || at == p)
+            continue;
+        if(boring(p, at - p) || (at - p == lastLen && strncmp(p, last, lastLen) == 0))
+            continue;
+        last = p;
+        lastLen = at - p;
+        if(strlen(sig) + (at - p) + 4 >= sz)
+            break;
+        strcat(sig, nframes ? " < " : " | ");
+        strncat(sig, p, at - p);
+        nframes++;
+    }
+    return 1;
+}
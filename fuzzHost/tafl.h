@@ -0,0 +1,83 @@
+/*
+ * testAfl internals.
+ */
+
+#include "../../TriforceAFL/config.h"
+#include "../targ/done.h"
+
+void xperror(int cond, char *msg);
+double timeDelta(struct timeval *start, struct timeval *end);
+void copyFile(char *dst, char *src);
+
+/* a VM (or any AFL instrumented program) running a fork server */
+struct vm {
+    int id;
+    pid_t pid;
+    int ctl, st;            /* fork server control and status pipes */
+    int shmid;
+    unsigned char *map;
+    char fuzzFn[32];        /* replaces @@ in the command line */
+    char conFn[32];         /* console output, with captureConsole */
+    int con;
+    off_t conOff;           /* where the current test's output starts */
+    double bootSecs;
+};
+
+/* afl-fuzz hit count buckets */
+#define NBUCKETS 8
+
+/* what happened to one input */
+struct result {
+    volatile int done;
+    int vm;
+    int status;             /* wait status from the fork server */
+    int edges;
+    int buckets[NBUCKETS];  /* edges in each bucket */
+    int timedOut;
+    double secs;            /* from GOGO to status */
+    int cached;             /* from the result cache, not run */
+    int unstable;           /* entries that changed between runs */
+    u_int32_t unstableIdx[8];   /* the first few of them */
+};
+
+extern int timeoutMs;
+extern size_t mapSize;
+extern int captureConsole;
+
+int vmStart(struct vm *v, int id, char **argv);
+int vmRun(struct vm *v, char *fname, struct result *r);
+int vmStop(struct vm *v);
+size_t vmConsole(struct vm *v, char *buf, size_t sz);
+
+/*
+ * Coverage archive record, followed by nameLen bytes of NUL padded
+ * name and nedges u_int32_t entries of map index << 3 | bucket.
+ */
+#define COVMAGIC 0x32766f63 /* "cov2" */
+#define MAXMAP (1 << 26)
+struct covRec {
+    u_int32_t magic;
+    u_int32_t mapSize;
+    u_int32_t nameLen;
+    u_int32_t nedges;
+    u_int32_t status;
+    u_int32_t usec;
+};
+
+int covCount(unsigned char *map, size_t sz, int *hist);
+int covSparse(unsigned char *map, size_t sz, u_int32_t *ents);
+int covSave(int fd, char *name, struct result *r, unsigned char *map, size_t sz);
+int covNext(FILE *fp, struct covRec *h, char **name, u_int32_t **ents);
+void covMerge(unsigned char *map, size_t sz, unsigned char *seen);
+int covDiff(unsigned char *a, unsigned char *b, size_t sz, u_int32_t *idx);
+int covLoadMask(char *fn, size_t sz);
+void covMask(unsigned char *map);
+
+u_int64_t hashBytes(u_int64_t h, void *p, size_t n);
+u_int64_t hashFile(u_int64_t h, char *fn);
+void cacheOpen(char *fn);
+int cacheGet(u_int64_t input, u_int64_t cfg, struct result *r);
+void cachePut(u_int64_t input, u_int64_t cfg, struct result *r);
+void cacheClose(void);
+
+int crashSig(char *log, size_t n, char *sig, size_t sz);
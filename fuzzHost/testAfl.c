@@ -3,196 +3,1143 @@
  * This is useful for debugging the forkserver and instrumented code and
  * for reproducing test cases.
  *
- * gcc -g -Wall testAfl.c -o testAfl
- * ./testAfl ./instrprog args with @@ in them
+ * With -j n, n copies of the program are booted and inputs are handed
+ * out to them from a shared queue.  Results are printed in input order.
+ * With -C, each input's coverage is appended to an archive.  With -J,
+ * a JSON line is written for each input and a summary with latency
+ * percentiles every -P inputs and at the end.
+ *
+ * Tests are killed after -t ms.  With -T k, the first -c inputs are
+ * run to calibrate the timeout, and the rest are run with a timeout of
+ * k times the calibration inputs' p99 latency.  Inputs taking over half
+ * the timeout are listed at the end.
+ *
+ * With -K cache, results are kept in a cache keyed by the input's
+ * contents and the configuration, and inputs already in it aren't run
+ * again unless -F is given.
+ *
+ * The map has -m entries.  The summary estimates, from the edges seen
+ * over all inputs, how many edges there really are and how many of
+ * them share map entries with others.
+ *
+ * With -R k, each input is run k times and the map entries whose hit
+ * count bucket changes are reported as unstable; -U writes them all
+ * to a mask.  -X clears the entries in a mask after every run.
+ *
+ * With -B dir, each VM's console goes to a file, and crashes are put
+ * in buckets by the signature of the panic in their console output.
+ * One input from each bucket is copied to dir with its console output.
+ *
+ * With -S sock, testAfl runs as a daemon instead: it boots the VMs
+ * once, then reads input file names, one per line, from clients
+ * connecting to the Unix socket sock and answers each with a JSON
+ * line.  A VM is only rebooted when its fork server dies.
+ *
+ * gcc -g -Wall testAfl.c vm.c cov.c cache.c -o testAfl
+ * ./testAfl [-j n] [-m size -M] [-t ms] [-T k] [-C archive] [-J json] [-K cache [-F] [-I image]] [-R k [-U mask]] [-X mask] [-B dir] [-d dir] [-L list] ./instrprog args with @@ in them -- files
+ * ./testAfl -S sock [-j n] [-m size -M] [-t ms] [-C archive] [-X mask] ./instrprog args with @@ in them
  */
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <sys/wait.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
 
-#include "../../TriforceAFL/config.h"
+#include "tafl.h"
+
+static volatile int forceQuit = 0;
+
+static char **files;
+static size_t nfiles, maxfiles;
+
+/* shared between the workers and the parent */
+struct queue {
+    volatile size_t next;
+    volatile int booted;
+    volatile long bootUsec;
+    volatile int timeoutMs;     /* set once calibration is done */
+    volatile int calibrated;
+    volatile size_t calDone;
+};
+static struct queue *queue;
+static struct result *results;
+static unsigned char *seen;     /* map entries hit by any input, shared */
+static int *unstableCount;      /* inputs each entry was unstable in, shared */
+
+/* crash signatures and console output, shared */
+#define SIGLEN 256
+#define CONLEN 8192
+struct crash {
+    char sig[SIGLEN];
+    char log[CONLEN];
+};
+static struct crash *crashes;
+static char *bucketDir;
+static int maxEdges = 0;
+
+/* how test cases ended: rejection reasons, truncations, signals */
+static char *rejNames[NREJ] = REJNAMES;
+static int rejCount[NREJ + 1];
+static int nTrunc = 0, nSig = 0;
+static long bucketCount[NBUCKETS];
+static char *bucketNames[NBUCKETS] = { "1", "2", "3", "4-7", "8-15", "16-31", "32-127", "128+" };
+
+static int covFd = -1;
+static int mapSizeOk = 0;      /* -M: prog sizes its map from AFL_MAP_SIZE */
+
+/* result cache */
+static int useCache = 0, forceRun = 0, nCached = 0;
+static u_int64_t cfgHash, *inHash;
+static char *images[16];
+static int nimages;
+
+/* stability */
+#define MAXUNSTABLE 10
+static int stabRuns = 0, nUnstable = 0;
+static char *maskIn, *maskOut;
+
+/* exec times in input order, for the percentiles */
+static long *lat;           /* of the inputs that were run, not cached */
+static size_t nlat;
+static FILE *jsonFp;
+static int jsonEvery = 1000;
+static struct timeval startBoot;
+static int njobs = 1;
+
+/* timeout calibration */
+#define MINTIMEOUT 5        /* ms, so scheduling jitter doesn't kill tests */
+#define MAXNEAR 20
+static double calK = 0;
+static size_t calN = 200;
+
+static void
+intHandler(int sig)
+{
+    forceQuit = 1;
+    signal(SIGINT, SIG_DFL);
+}
+
+static void
+usage(char *prog)
+{
+    printf("usage:  %s [-j n] [-m size -M] [-t ms] [-T k] [-c n] [-C archive] [-J json] [-P n] [-K cache [-F] [-I image]] [-R k [-U mask]] [-X mask] [-B dir] [-d dir] [-L list] prog args ... [-- files ...]\n", prog);
+    printf("        %s -S sock [-j n] [-m size -M] [-t ms] [-C archive] [-X mask] prog args ...\n", prog);
+    printf("\t\t-B dir\tbucket crashes by their console output and copy one from each bucket to dir\n");
+    printf("\t\t-C archive\tappend each input's coverage to archive\n");
+    printf("\t\t-d dir\trun every file in dir\n");
+    printf("\t\t-J json\twrite a JSON line per input and summaries to json\n");
+    printf("\t\t-m size\tuse a map of size entries, a power of two, with an optional k or m (default %dk)\n", MAP_SIZE / 1024);
+    printf("\t\t-M\tprog sizes its map from AFL_MAP_SIZE (needed with -m; QEMU must be rebuilt)\n");
+    printf("\t\t-P n\twrite a JSON summary every n inputs (default 1000)\n");
+    printf("\t\t-c n\tcalibrate the timeout with the first n inputs (default 200)\n");
+    printf("\t\t-t ms\tkill tests after ms milliseconds, the most allowed with -T (default 2000)\n");
+    printf("\t\t-T k\tset the timeout to k times the p99 latency of the calibration inputs\n");
+    printf("\t\t-j n\tboot n copies of prog and run inputs in parallel (default 1)\n");
+    printf("\t\t-F\trun inputs even if they are in the cache\n");
+    printf("\t\t-I image\tadd image's contents to the cache key (may be repeated)\n");
+    printf("\t\t-K cache\tkeep results in cache and don't rerun inputs found in it\n");
+    printf("\t\t-R k\trun each input k times and report unstable map entries\n");
+    printf("\t\t-U mask\twrite the unstable entries to mask\n");
+    printf("\t\t-X mask\tignore the entries listed in mask\n");
+    printf("\t\t-S sock\trun as a daemon, taking file names from clients of the Unix socket sock\n");
+    printf("\t\t-L list\trun the files named in list, one per line, or stdin if list is -\n");
+    printf("\t\t@@ in the args is replaced with the input file name\n");
+    exit(1);
+}
+
+static size_t
+parseSize(char *s)
+{
+    char *end;
+    size_t x;
+
+    x = strtoul(s, &end, 0);
+    if(*end == 'k' || *end == 'K')
+        x *= 1024;
+    else if(*end == 'm' || *end == 'M')
+        x *= 1024 * 1024;
+    return x;
+}
+
+static void
+addFile(char *fn)
+{
+    if(nfiles == maxfiles) {
+        maxfiles = maxfiles ? maxfiles * 2 : 1024;
+        files = realloc(files, maxfiles * sizeof files[0]);
+        xperror(!files, "realloc");
+    }
+    files[nfiles++] = fn;
+}
+
+static int
+cmpName(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+static void
+addDir(char *dir)
+{
+    struct dirent *ent;
+    char fn[1024];
+    size_t start;
+    DIR *d;
+
+    d = opendir(dir);
+    xperror(!d, dir);
+    start = nfiles;
+    while((ent = readdir(d)) != NULL) {
+        if(ent->d_name[0] == '.')
+            continue;
+        snprintf(fn, sizeof fn, "%s/%s", dir, ent->d_name);
+        addFile(strdup(fn));
+    }
+    closedir(d);
+    qsort(files + start, nfiles - start, sizeof files[0], cmpName);
+}
+
+static void
+addList(char *list)
+{
+    char line[1024];
+    FILE *fp;
+
+    fp = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+    xperror(!fp, list);
+    while(fgets(line, sizeof line, fp)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if(line[0])
+            addFile(strdup(line));
+    }
+    if(fp != stdin)
+        fclose(fp);
+}
 
-#define FUZZFN ".fuzzdat"
+static int
+cmpSecs(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
 
-static int forceQuit = 0;
+    return x < y ? -1 : x > y;
+}
+
+/* set the timeout from the calibration inputs, all of which are done */
+static void
+calibrate(void)
+{
+    double *secs, p99;
+    size_t i;
+    int ms;
+
+    secs = malloc(calN * sizeof secs[0]);
+    xperror(!secs, "malloc");
+    for(i = 0; i < calN; i++)
+        secs[i] = results[i].secs;
+    qsort(secs, calN, sizeof secs[0], cmpSecs);
+    p99 = secs[(calN - 1) * 99 / 100];
+    free(secs);
+
+    ms = calK * p99 * 1000 + 1;
+    if(ms < MINTIMEOUT)
+        ms = MINTIMEOUT;
+    if(ms < queue->timeoutMs)
+        queue->timeoutMs = ms;
+    __sync_synchronize();
+    queue->calibrated = 1;
+}
 
-void xperror(int cond, char *msg) {
-    if(cond) {
-        perror(msg);
+/*
+ * Hash the configuration: the command line, the timeout, the program
+ * and any images.  The command line includes the driver's flags.
+ */
+static u_int64_t
+configHash(char **argv)
+{
+    u_int64_t h = 0;
+    int i;
+
+    for(i = 0; argv[i]; i++)
+        h = hashBytes(h, argv[i], strlen(argv[i]) + 1);
+    h = hashBytes(h, &timeoutMs, sizeof timeoutMs);
+    h = hashBytes(h, &mapSize, sizeof mapSize);
+    if(strchr(argv[0], '/')) {
+        h = hashFile(h, argv[0]);
+        xperror(!h, argv[0]);
+    }
+    for(i = 0; i < nimages; i++) {
+        h = hashFile(h, images[i]);
+        xperror(!h, images[i]);
+    }
+    if(maskIn)
+        h = hashFile(h, maskIn);
+    return h;
+}
+
+/* fill in the cached results, returning how many there were */
+static size_t
+loadCached(void)
+{
+    size_t i, n = 0;
+
+    inHash = calloc(nfiles, sizeof inHash[0]);
+    xperror(!inHash, "calloc");
+    for(i = 0; i < nfiles; i++) {
+        /* unreadable inputs are left for the workers to complain about */
+        inHash[i] = hashFile(0, files[i]);
+        /* coverage, stability and console output aren't cached */
+        if(!forceRun && covFd == -1 && !stabRuns && !bucketDir && inHash[i] && cacheGet(inHash[i], cfgHash, &results[i])) {
+            results[i].done = 1;
+            n++;
+            if(i < calN)
+                queue->calDone++;
+        }
+    }
+    return n;
+}
+
+/*
+ * Run an input stabRuns - 1 more times and compare the maps with the
+ * first run's, which is left in the map.
+ */
+static void
+checkStable(struct vm *v, size_t i)
+{
+    static unsigned char *first, *unst;
+    static u_int32_t *diff, *list;
+    struct result r;
+    int j, k, n, nlist = 0;
+    u_int32_t x;
+
+    if(!first) {
+        first = malloc(mapSize);
+        unst = calloc(mapSize / 8, 1);
+        diff = malloc(mapSize * sizeof diff[0]);
+        list = malloc(mapSize * sizeof list[0]);
+        xperror(!first || !unst || !diff || !list, "malloc");
+    }
+    memcpy(first, v->map, mapSize);
+    for(j = 1; j < stabRuns; j++) {
+        if(vmRun(v, files[i], &r) == -1) {
+            fprintf(stderr, "vm %d: fork server died\n", v->id);
+            exit(1);
+        }
+        n = covDiff(first, v->map, mapSize, diff);
+        for(k = 0; k < n; k++) {
+            x = diff[k];
+            if(!(unst[x >> 3] & (1 << (x & 7)))) {
+                unst[x >> 3] |= 1 << (x & 7);
+                list[nlist++] = x;
+            }
+        }
+    }
+    results[i].unstable = nlist;
+    for(k = 0; k < nlist; k++) {
+        x = list[k];
+        unst[x >> 3] = 0;
+        __sync_fetch_and_add(&unstableCount[x], 1);
+        if(k < sizeof results[i].unstableIdx / sizeof results[i].unstableIdx[0])
+            results[i].unstableIdx[k] = x;
+    }
+    memcpy(v->map, first, mapSize);
+}
+
+/* save the console output and signature of a crash */
+static void
+checkCrash(struct vm *v, size_t i)
+{
+    struct result *r = &results[i];
+    struct crash *c = &crashes[i];
+    size_t n;
+
+    if(!r->timedOut && !WIFSIGNALED(r->status))
+        return;
+    n = vmConsole(v, c->log, sizeof c->log);
+    if(r->timedOut)
+        snprintf(c->sig, sizeof c->sig, "timeout");
+    else if(!crashSig(c->log, n, c->sig, sizeof c->sig))
+        snprintf(c->sig, sizeof c->sig, "signal %d", WTERMSIG(r->status));
+}
+
+/* boot a VM and run inputs from the queue until it is empty */
+static void
+worker(int id, char **argv)
+{
+    struct vm vm;
+    size_t i;
+    int status;
+
+    signal(SIGINT, intHandler);
+    if(vmStart(&vm, id, argv) == -1) {
+        fprintf(stderr, "vm %d: fork server didn't start\n", id);
         exit(1);
     }
+    __sync_fetch_and_add(&queue->booted, 1);
+    __sync_fetch_and_add(&queue->bootUsec, (long)(vm.bootSecs * 1000000));
+    while(!forceQuit) {
+        i = __sync_fetch_and_add(&queue->next, 1);
+        if(i >= nfiles)
+            break;
+        if(results[i].cached)
+            continue;
+        /* the rest wait for the calibrated timeout */
+        while(i >= calN && !queue->calibrated && !forceQuit)
+            usleep(1000);
+        timeoutMs = queue->timeoutMs;
+        if(vmRun(&vm, files[i], &results[i]) == -1) {
+            fprintf(stderr, "vm %d: fork server died\n", id);
+            exit(1);
+        }
+        if(crashes)
+            checkCrash(&vm, i);
+        if(stabRuns > 1)
+            checkStable(&vm, i);
+        if(covFd != -1 && covSave(covFd, files[i], &results[i], vm.map, mapSize) == -1)
+            perror("coverage archive");
+        covMerge(vm.map, mapSize, seen);
+        results[i].done = 1;
+        if(i < calN && __sync_add_and_fetch(&queue->calDone, 1) == calN)
+            calibrate();
+    }
+    status = vmStop(&vm);
+    if(id == 0 || status)
+        printf("fork server %d ended with status %x\n", id, status);
+    exit(0);
 }
 
-void writeFile(char *fn, char *buf) {
-    FILE *fp = fopen(fn, "w");
-    xperror(!fp, fn);
-    fwrite(buf, 1, strlen(buf), fp);
-    fclose(fp);
+static void
+jsonString(FILE *fp, char *s)
+{
+    putc('"', fp);
+    for(; *s; s++) {
+        if(*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", *s);
+        else
+            putc(*s, fp);
+    }
+    putc('"', fp);
 }
 
-void copyFile(char *dst, char *src) {
-    char ch;
-    FILE *o = fopen(dst, "w");
-    FILE *i = fopen(src, "r");
+static void
+jsonResult(FILE *fp, char *fn, struct result *r)
+{
+    int x;
 
-    xperror(!o, dst);
-    xperror(!i, src);
-    while(fread(&ch, 1, 1, i) == 1)
-        fwrite(&ch, 1, 1, o);
-    fclose(i);
-    fclose(o);
+    fprintf(fp, "{\"type\":\"exec\",\"file\":");
+    jsonString(fp, fn);
+    fprintf(fp, ",\"vm\":%d,\"status\":%d", r->vm, r->status);
+    if(WIFEXITED(r->status)) {
+        x = WEXITSTATUS(r->status) & DONE_REJMASK;
+        fprintf(fp, ",\"reject\":\"%s\",\"truncated\":%s", x < NREJ ? rejNames[x] : "unknown",
+            (WEXITSTATUS(r->status) & DONE_TRUNC) ? "true" : "false");
+    } else if(WIFSIGNALED(r->status)) {
+        fprintf(fp, ",\"signal\":%d", WTERMSIG(r->status));
+    }
+    if(r->cached)
+        fprintf(fp, ",\"cached\":true");
+    if(stabRuns > 1)
+        fprintf(fp, ",\"unstable\":%d", r->unstable);
+    if(crashes && crashes[r - results].sig[0]) {
+        fprintf(fp, ",\"signature\":");
+        jsonString(fp, crashes[r - results].sig);
+    }
+    fprintf(fp, ",\"timeout\":%s,\"edges\":%d,\"usec\":%ld}\n",
+        r->timedOut ? "true" : "false", r->edges, (long)(r->secs * 1000000));
 }
 
-int srv[2];
-unsigned char *map;
+static int
+cmpLong(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
 
-int workpid = -1;
+    return x < y ? -1 : x > y;
+}
 
+/* latency percentiles over the inputs run so far, or 0 if none were */
 static void
-alarmHandler(int sig)
+latencies(long *p50, long *p90, long *p99, long *max)
 {
-    if(workpid != -1) {
-        kill(workpid, SIGKILL);
-        printf("\ntimeout\n");
+    static long *sorted;
+    static size_t nsorted;
+
+    if(nlat == 0) {
+        *p50 = *p90 = *p99 = *max = 0;
+        return;
+    }
+    if(nlat > nsorted) {
+        sorted = realloc(sorted, nlat * sizeof sorted[0]);
+        xperror(!sorted, "realloc");
+        nsorted = nlat;
     }
+    memcpy(sorted, lat, nlat * sizeof lat[0]);
+    qsort(sorted, nlat, sizeof sorted[0], cmpLong);
+    *p50 = sorted[(nlat - 1) * 50 / 100];
+    *p90 = sorted[(nlat - 1) * 90 / 100];
+    *p99 = sorted[(nlat - 1) * 99 / 100];
+    *max = sorted[nlat - 1];
+}
+
+static double
+bootSecs(void)
+{
+    return queue->booted ? queue->bootUsec / 1000000.0 / queue->booted : 0;
 }
 
 static void
-intHandler(int sig)
+jsonSummary(int final)
 {
-    forceQuit = 1;
-    signal(SIGINT, SIG_DFL);
+    struct timeval now;
+    long p50, p90, p99, max;
+    double total, boot;
+
+    if(nlat + nCached == 0)
+        return;
+    gettimeofday(&now, 0);
+    total = timeDelta(&startBoot, &now);
+    boot = bootSecs();
+    latencies(&p50, &p90, &p99, &max);
+    fprintf(jsonFp, "{\"type\":\"%s\",\"tests\":%ld,\"vms\":%d,\"boot_secs\":%.3f,"
+        "\"secs\":%.3f,\"cached\":%d,\"execs_per_sec\":%.2f,"
+        "\"p50_usec\":%ld,\"p90_usec\":%ld,\"p99_usec\":%ld,\"max_usec\":%ld,\"timeout_ms\":%d}\n",
+        final ? "final" : "summary", (long)(nlat + nCached), njobs, boot, total, nCached,
+        total > boot ? nlat / (total - boot) : 0, p50, p90, p99, max, queue->timeoutMs);
+    fflush(jsonFp);
 }
 
-void
-runTest(char *fname, char *dat)
+static void
+showResult(size_t i, struct result *r)
 {
-    int status, cnt, i, x;
+    int x;
 
-    if(dat)
-        writeFile(FUZZFN, dat);
+    if(r->edges > maxEdges)
+        maxEdges = r->edges;
+    if(r->cached) {
+        nCached++;
+    } else {
+        lat[nlat++] = r->secs * 1000000;
+        if(useCache && inHash[i] && !(r->timedOut && calK))
+            cachePut(inHash[i], cfgHash, r);    /* calibrated timeouts aren't in the key */
+    }
+    if(jsonFp) {
+        jsonResult(jsonFp, files[i], r);
+        if((i + 1) % jsonEvery == 0)
+            jsonSummary(0);
+    }
+
+    printf("Input from %s\n", files[i]);
+    if(r->timedOut)
+        printf("timeout\n");
+    if(r->cached)
+        printf("test ended with status %x in %.2f ms (cached)\n", r->status, r->secs * 1000);
     else
-        copyFile(FUZZFN, fname);
+        printf("test ended with status %x in %.2f ms on vm %d\n", r->status, r->secs * 1000, r->vm);
+    if(crashes && crashes[i].sig[0])
+        printf("crash: %s\n", crashes[i].sig);
+    if(WIFEXITED(r->status)) {
+        x = WEXITSTATUS(r->status) & DONE_REJMASK;
+        if(x >= NREJ)
+            x = NREJ;
+        rejCount[x]++;
+        if(WEXITSTATUS(r->status) & DONE_TRUNC)
+            nTrunc++;
+        if(x != REJ_NONE)
+            printf("rejected: %s\n", x < NREJ ? rejNames[x] : "unknown");
+    } else {
+        nSig++;
+    }
+    printf("%d edges", r->edges);
+    if(r->edges && !r->cached) {
+        printf(", hit counts");
+        for(x = 0; x < NBUCKETS; x++) {
+            bucketCount[x] += r->buckets[x];
+            if(r->buckets[x])
+                printf(" %s:%d", bucketNames[x], r->buckets[x]);
+        }
+    }
+    printf("\n");
+    if(r->unstable) {
+        nUnstable++;
+        printf("%d unstable:", r->unstable);
+        for(x = 0; x < r->unstable && x < sizeof r->unstableIdx / sizeof r->unstableIdx[0]; x++)
+            printf(" %d", r->unstableIdx[x]);
+        printf(x < r->unstable ? " ...\n" : "\n");
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void
+showNear(void)
+{
+    size_t i;
+    int n = 0;
+
+    for(i = 0; i < nfiles; i++) {
+        if(!results[i].done || results[i].secs * 1000 < queue->timeoutMs / 2.0)
+            continue;
+        if(n++ == 0)
+            printf("near or over the timeout:\n");
+        if(n <= MAXNEAR)
+            printf("  %8.2f ms %s%s\n", results[i].secs * 1000, files[i], results[i].timedOut ? " (timed out)" : "");
+    }
+    if(n > MAXNEAR)
+        printf("  ... and %d more\n", n - MAXNEAR);
+}
+
+static void
+showRejects(int n)
+{
+    int i;
+
+    printf("outcomes:\n");
+    for(i = 0; i <= NREJ; i++) {
+        if(rejCount[i])
+            printf("  %-10s %6d  %5.1f%%\n", i < NREJ ? rejNames[i] : "unknown", rejCount[i], 100.0 * rejCount[i] / n);
+    }
+    if(nSig)
+        printf("  %-10s %6d  %5.1f%%\n", "signal", nSig, 100.0 * nSig / n);
+    if(nTrunc)
+        printf("  %-10s %6d  %5.1f%%\n", "truncated", nTrunc, 100.0 * nTrunc / n);
+}
+
+static void
+showBuckets(void)
+{
+    long tot = 0;
+    int i;
+
+    for(i = 0; i < NBUCKETS; i++)
+        tot += bucketCount[i];
+    if(!tot)
+        return;
+    printf("hit counts:\n");
+    for(i = 0; i < NBUCKETS; i++)
+        printf("  %-10s %6ld  %5.1f%%\n", bucketNames[i], bucketCount[i], 100.0 * bucketCount[i] / tot);
+}
+
+/*
+ * If E edges are hashed into M entries, about M(1 - e^-E/M) entries
+ * are hit, so E can be estimated from the entries hit by all inputs.
+ * The edges not accounted for collided with others.
+ */
+static double
+collisions(double edges, double m)
+{
+    return 1 - m * (1 - exp(-edges / m)) / edges;
+}
+
+static void
+showMap(void)
+{
+    double u, m, est;
+    size_t i, hit = 0, sz;
+
+    for(i = 0; i < mapSize / 8; i++)
+        hit += __builtin_popcount(seen[i]);
+    if(!hit)
+        return;
+    u = hit;
+    m = mapSize;
+    printf("map:       %ld entries, %ld hit (%.2f%%), at most %d by one input (%.2f%%)\n",
+        (long)mapSize, (long)hit, 100 * u / m, maxEdges, 100.0 * maxEdges / m);
+    if(hit == mapSize) {
+        printf("           saturated, use a bigger map\n");
+        return;
+    }
+    est = -m * log(1 - u / m);
+    for(sz = 4096; sz < MAXMAP && collisions(est, sz) > 0.01; sz *= 2)
+        continue;
+    printf("           about %.0f edges, %.2f%% colliding; %ldk entries keeps it under 1%%\n",
+        est, 100 * collisions(est, m), (long)sz / 1024);
+}
+
+static int
+cmpUnstable(const void *a, const void *b)
+{
+    u_int32_t x = *(const u_int32_t *)a, y = *(const u_int32_t *)b;
+
+    if(unstableCount[x] != unstableCount[y])
+        return unstableCount[y] - unstableCount[x];
+    return x < y ? -1 : x > y;
+}
+
+/* summarize the unstable entries, and write them to maskOut */
+static void
+showStability(size_t shown)
+{
+    u_int32_t *idx;
+    size_t i, n, hit = 0;
+    FILE *fp;
+
+    idx = malloc(mapSize * sizeof idx[0]);
+    xperror(!idx, "malloc");
+    for(i = n = 0; i < mapSize; i++) {
+        if(unstableCount[i])
+            idx[n++] = i;
+        if(seen[i >> 3] & (1 << (i & 7)))
+            hit++;
+    }
+    qsort(idx, n, sizeof idx[0], cmpUnstable);
+    printf("stability: %ld of %ld inputs stable over %d runs, %ld of %ld entries unstable\n",
+        (long)(shown - nUnstable), (long)shown, stabRuns, (long)n, (long)hit);
+    for(i = 0; i < n && i < MAXUNSTABLE; i++)
+        printf("  %8d  unstable in %d inputs\n", idx[i], unstableCount[idx[i]]);
+
+    if(maskOut) {
+        fp = fopen(maskOut, "w");
+        xperror(!fp, maskOut);
+        fprintf(fp, "# %ld unstable entries of a %ld entry map over %d runs, with the inputs each was unstable in\n",
+            (long)n, (long)mapSize, stabRuns);
+        for(i = 0; i < n; i++)
+            fprintf(fp, "%d %d\n", idx[i], unstableCount[idx[i]]);
+        fclose(fp);
+    }
+    free(idx);
+}
+
+struct bucket {
+    size_t first, n;        /* range in the sorted crash list */
+};
+
+static long *sizes;
+
+static int
+cmpCrash(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    int c;
+
+    c = strcmp(crashes[x].sig, crashes[y].sig);
+    if(c)
+        return c;
+    if(sizes[x] != sizes[y])
+        return sizes[x] < sizes[y] ? -1 : 1;
+    return strcmp(files[x], files[y]);
+}
+
+static int
+cmpBucket(const void *a, const void *b)
+{
+    const struct bucket *x = a, *y = b;
+
+    if(x->n != y->n)
+        return x->n > y->n ? -1 : 1;
+    return x->first < y->first ? -1 : 1;
+}
+
+/*
+ * Group the crashes by signature and copy the smallest input from each
+ * bucket to bucketDir as crashN, with crashN.txt holding the signature,
+ * the bucket's inputs and the console output.
+ */
+static void
+showCrashes(void)
+{
+    struct bucket *b;
+    struct stat st;
+    size_t i, j, n, nb, *idx;
+    char fn[1024];
+    FILE *fp;
+
+    idx = malloc(nfiles * sizeof idx[0]);
+    sizes = calloc(nfiles, sizeof sizes[0]);
+    b = malloc(nfiles * sizeof b[0]);
+    xperror(!idx || !sizes || !b, "malloc");
+    for(i = n = 0; i < nfiles; i++) {
+        if(results[i].done && crashes[i].sig[0]) {
+            idx[n++] = i;
+            if(stat(files[i], &st) == 0)
+                sizes[i] = st.st_size;
+        }
+    }
+    if(n == 0)
+        return;
+    qsort(idx, n, sizeof idx[0], cmpCrash);
+    for(i = nb = 0; i < n; i++) {
+        if(i == 0 || strcmp(crashes[idx[i]].sig, crashes[idx[i - 1]].sig) != 0) {
+            b[nb].first = i;
+            b[nb++].n = 0;
+        }
+        b[nb - 1].n++;
+    }
+    qsort(b, nb, sizeof b[0], cmpBucket);
 
-    memset(map, 0, MAP_SIZE);
-    x = write(srv[1], "GOGO", 4);
-    xperror(x != 4, "write go");
+    if(mkdir(bucketDir, 0755) == -1 && errno != EEXIST)
+        xperror(1, bucketDir);
+    printf("crash buckets: %ld crashes in %ld buckets\n", (long)n, (long)nb);
+    for(i = 0; i < nb; i++) {
+        j = idx[b[i].first];
+        printf("  %6ld  %s\n          %s\n", (long)b[i].n, crashes[j].sig, files[j]);
+
+        snprintf(fn, sizeof fn, "%s/crash%ld", bucketDir, (long)i);
+        copyFile(fn, files[j]);
+        snprintf(fn, sizeof fn, "%s/crash%ld.txt", bucketDir, (long)i);
+        fp = fopen(fn, "w");
+        xperror(!fp, fn);
+        fprintf(fp, "%s\n\n%ld inputs:\n", crashes[j].sig, (long)b[i].n);
+        for(n = 0; n < b[i].n; n++)
+            fprintf(fp, "%s\n", files[idx[b[i].first + n]]);
+        fprintf(fp, "\nconsole output from %s:\n%s", files[j], crashes[j].log);
+        fclose(fp);
+    }
+    free(idx);
+    free(b);
+}
 
-    x = read(srv[0], &workpid, 4);
-    xperror(x != 4, "read pid");
-    printf("test running in pid %d\n", workpid);
+static void
+bootVm(struct vm *v, int id, char **argv)
+{
+    if(vmStart(v, id, argv) == -1) {
+        fprintf(stderr, "vm %d: fork server didn't start\n", id);
+        exit(1);
+    }
+    printf("{\"type\":\"boot\",\"vm\":%d,\"boot_secs\":%.3f}\n", id, v->bootSecs);
     fflush(stdout);
-    alarm(2);
-    do {
-        x = read(srv[0], &status, 4);
-    } while(x == -1 && errno == EINTR);
-    xperror(x != 4, "read status");
-    alarm(0);
-    workpid = -1;
-    printf("test ended with status %x\n", status);
-    cnt = 0;
-    for(i = 0; i < MAP_SIZE; i++) {
-        if(map[i]) cnt++;
+}
+
+/* answer each file name from a client with a JSON line */
+static void
+serveClient(int fd, struct vm *v, char **argv)
+{
+    struct result r;
+    char line[1024];
+    FILE *in, *out;
+    int x;
+
+    in = fdopen(fd, "r");
+    out = fdopen(fcntl(fd, F_DUPFD_CLOEXEC, 0), "w");
+    xperror(!in || !out, "fdopen");
+    while(fgets(line, sizeof line, in)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if(!line[0])
+            continue;
+        if(access(line, R_OK) == -1) {
+            fprintf(out, "{\"type\":\"error\",\"file\":");
+            jsonString(out, line);
+            fprintf(out, ",\"error\":\"%s\"}\n", strerror(errno));
+            fflush(out);
+            continue;
+        }
+        memset(&r, 0, sizeof r);
+        x = vmRun(v, line, &r);
+        if(x == -1) {
+            /* it may have died before this input, so try it once more */
+            vmStop(v);
+            bootVm(v, v->id, argv);
+            memset(&r, 0, sizeof r);
+            x = vmRun(v, line, &r);
+        }
+        if(x == -1) {
+            fprintf(out, "{\"type\":\"error\",\"file\":");
+            jsonString(out, line);
+            fprintf(out, ",\"error\":\"fork server died\"}\n");
+            fflush(out);
+            vmStop(v);
+            bootVm(v, v->id, argv);
+        } else {
+            jsonResult(out, line, &r);
+            if(covFd != -1 && covSave(covFd, line, &r, v->map, mapSize) == -1)
+                perror("coverage archive");
+        }
+        if(fflush(out) == EOF)
+            break;
     }
-    printf("%d edges\n\n", cnt);
+    fclose(in);
+    fclose(out);
 }
 
-static double timeDelta(struct timeval *start, struct timeval *end)
+/* boot njobs VMs and serve clients of the socket forever */
+static void
+daemonMode(char *path, char **argv)
 {
-    struct timeval d;
+    struct sockaddr_un sun;
+    struct vm vm;
+    int s, fd, w;
+    pid_t pid;
+
+    memset(&sun, 0, sizeof sun);
+    sun.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof sun.sun_path) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        exit(1);
+    }
+    strcpy(sun.sun_path, path);
+    s = socket(AF_UNIX, SOCK_STREAM, 0);
+    xperror(s == -1, "socket");
+    fcntl(s, F_SETFD, FD_CLOEXEC);
+    unlink(path);
+    xperror(bind(s, (struct sockaddr *)&sun, sizeof sun) == -1, path);
+    xperror(listen(s, 16) == -1, "listen");
 
-    timersub(end, start, &d);
-    return d.tv_sec + d.tv_usec / 1000000.0;
+    /* each VM takes the next client to connect */
+    fflush(stdout);
+    for(w = 0; w < njobs; w++) {
+        pid = fork();
+        xperror(pid == -1, "fork");
+        if(pid)
+            continue;
+        bootVm(&vm, w, argv);
+        for(;;) {
+            fd = accept(s, NULL, NULL);
+            if(fd == -1) {
+                xperror(errno != EINTR && errno != ECONNABORTED, "accept");
+                continue;
+            }
+            /* a rebooted VM mustn't hold the client open */
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            serveClient(fd, &vm, argv);
+        }
+    }
+    close(s);
+    while(wait(NULL) > 0 || errno == EINTR)
+        continue;
+    unlink(path);
+    exit(1);
 }
 
 int main(int argc, char **argv)
 {
-    char **files;
-    char idbuf[20], buf[100];
-    struct timeval startBoot, startTest, now;
-    int p[2], id, x, pid, status, i;
+    struct timeval now;
+    double boot, total;
+    long p50, p90, p99, max;
+    char *prog, *sock = NULL, *cacheFn = NULL, **fileArgs = NULL;
+    size_t i, shown, skipped, ncached;
+    int opt, running, nworkers, status, w;
+    pid_t pid;
 
-    signal(SIGALRM, alarmHandler);
+    prog = argv[0];
     signal(SIGINT, intHandler);
-    xperror(argc < 2, "bad usage");
-
-    /* make forkserver pipes */
-    x = pipe(p);
-    xperror(x == -1, "pipe1");
-    dup2(p[0], FORKSRV_FD);
-    srv[1] = p[1];
-    x = pipe(p);
-    xperror(x == -1, "pipe2");
-    dup2(p[1], FORKSRV_FD+1);
-    srv[0] = p[0];
-    
-    id = shmget(IPC_PRIVATE, MAP_SIZE, IPC_CREAT | IPC_EXCL | 0600);
-    map = shmat(id, NULL, 0);
-    xperror(id == -1 || map == NULL, "shmget");
-    sprintf(idbuf, "%d", id);
-
-    //setenv("AFLGETWORK", "1", 1);
-    setenv("__AFL_SHM_ID", idbuf, 1);
-    //setenv("AFL_INST_RATIO", "50", 1);
-
-    argv += 1;
+    /* options stop at the program to run */
+    while((opt = getopt(argc, argv, "+B:c:C:d:Fj:J:I:K:L:m:MP:R:S:t:T:U:X:")) != -1) {
+        switch(opt) {
+        case 'B':
+            bucketDir = optarg;
+            captureConsole = 1;
+            break;
+        case 'c':
+            calN = atoi(optarg);
+            break;
+        case 'C':
+            /* workers append whole records, so they can share the fd */
+            covFd = open(optarg, O_WRONLY | O_APPEND | O_CREAT, 0644);
+            xperror(covFd == -1, optarg);
+            break;
+        case 'd':
+            addDir(optarg);
+            break;
+        case 'F':
+            forceRun = 1;
+            break;
+        case 'I':
+            if(nimages == sizeof images / sizeof images[0])
+                usage(prog);
+            images[nimages++] = optarg;
+            break;
+        case 'j':
+            njobs = atoi(optarg);
+            break;
+        case 'J':
+            jsonFp = fopen(optarg, "w");
+            xperror(!jsonFp, optarg);
+            break;
+        case 'K':
+            cacheFn = optarg;
+            break;
+        case 'L':
+            addList(optarg);
+            break;
+        case 'm':
+            mapSize = parseSize(optarg);
+            if(mapSize < 4096 || mapSize > MAXMAP || (mapSize & (mapSize - 1)))
+                usage(prog);
+            break;
+        case 'M':
+            mapSizeOk = 1;
+            break;
+        case 'P':
+            jsonEvery = atoi(optarg);
+            break;
+        case 'R':
+            stabRuns = atoi(optarg);
+            break;
+        case 'S':
+            sock = optarg;
+            break;
+        case 't':
+            timeoutMs = atoi(optarg);
+            break;
+        case 'T':
+            calK = atof(optarg);
+            break;
+        case 'U':
+            maskOut = optarg;
+            break;
+        case 'X':
+            maskIn = optarg;
+            break;
+        default:
+            usage(prog);
+        }
+    }
+    argv += optind;
+    if(!argv[0] || njobs < 1 || jsonEvery < 1 || timeoutMs < 1 || calK < 0 || (calK && calN < 1))
+        usage(prog);
+
+    if(maskOut && stabRuns < 2)
+        usage(prog);
+    /* a tracer with a bigger compiled-in map would write past ours */
+    if(mapSize != MAP_SIZE && !mapSizeOk) {
+        fprintf(stderr, "%s: -m needs -M, and a program that sizes its map from AFL_MAP_SIZE\n", prog);
+        exit(1);
+    }
+    if(maskIn && covLoadMask(maskIn, mapSize) == -1)
+        xperror(1, maskIn);
+
     for(i = 1; argv[i]; i++) {
         if(strcmp(argv[i], "--") == 0)
             break;
-        if(strcmp(argv[i], "@@") == 0) 
-            argv[i] = FUZZFN;
     }
     if(argv[i]) {
         argv[i] = 0;
-        i++;
+        fileArgs = argv + i + 1;
+    }
+    if(sock) {
+        /* the daemon takes its inputs from clients */
+        if(fileArgs && fileArgs[0]) {
+            fprintf(stderr, "%s: -S doesn't take files\n", prog);
+            exit(1);
+        }
+        daemonMode(sock, argv);
+    }
+    for(i = 0; fileArgs && fileArgs[i]; i++)
+        addFile(fileArgs[i]);
+    if(nfiles == 0) {
+        printf("No files to test!\n");
+        return 0;
     }
-    files = argv + i;
 
-    /* run program to start forkserver */
-    gettimeofday(&startBoot, 0);
-    pid = fork();
-    if(pid == 0) {
-        close(srv[0]);
-        close(srv[1]);
-        execvp(argv[0], argv);
-        xperror(1, argv[0]);
+    queue = mmap(NULL, sizeof *queue + nfiles * sizeof results[0] + mapSize / 8
+        + (stabRuns > 1 ? mapSize * sizeof unstableCount[0] : 0),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    xperror(queue == MAP_FAILED, "mmap");
+    results = (struct result *)(queue + 1);
+    seen = (unsigned char *)(results + nfiles);
+    unstableCount = (int *)(seen + mapSize / 8);
+    if(bucketDir) {
+        crashes = mmap(NULL, nfiles * sizeof crashes[0], PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        xperror(crashes == MAP_FAILED, "mmap");
     }
+    queue->timeoutMs = timeoutMs;
+    if(!calK || calN > nfiles)
+        calN = calK ? nfiles : 0;
+    queue->calibrated = calN == 0;
+    lat = malloc(nfiles * sizeof lat[0]);
+    xperror(!lat, "malloc");
 
-    x = read(srv[0], buf, 4);
-    xperror(x != 4, "wait forkserver");
+    ncached = 0;
+    if(cacheFn) {
+        useCache = 1;
+        cacheOpen(cacheFn);
+        cfgHash = configHash(argv);
+        ncached = loadCached();
+        if(calN && queue->calDone == calN)
+            calibrate();
+    }
+    if(njobs > nfiles - ncached)
+        njobs = nfiles - ncached;
 
-    gettimeofday(&startTest, 0);
-    for(i = 0; files[i] && !forceQuit; i++) {
-        gettimeofday(&now, NULL);
-        printf("Input from %s at time %ld.%06ld\n", files[i], (u_long)now.tv_sec, (u_long)now.tv_usec);
-        runTest(files[i], 0);
+    /* each worker runs its own copy of the program */
+    gettimeofday(&startBoot, 0);
+    fflush(stdout);
+    for(w = 0; w < njobs; w++) {
+        pid = fork();
+        xperror(pid == -1, "fork");
+        if(pid == 0)
+            worker(w, argv);
     }
-    if(i == 0)
-        printf("No files to test!\n");
 
-    close(srv[0]);
-    close(srv[1]);
-    waitpid(pid, &status, 0);
-    printf("fork server ended with status %x\n", status);
+    /* print results in input order as they come in */
+    nworkers = njobs;
+    shown = 0;
+    for(running = njobs; running > 0; ) {
+        for(; shown < nfiles && results[shown].done; shown++)
+            showResult(shown, &results[shown]);
+        pid = waitpid(-1, &status, WNOHANG);
+        if(pid > 0) {
+            running--;
+            if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+                nworkers--;
+                /* its calibration input will never be done */
+                if(!queue->calibrated) {
+                    printf("timeout calibration failed, using %d ms\n", queue->timeoutMs);
+                    queue->calibrated = 1;
+                }
+            }
+        } else if(pid == -1 && errno != EINTR) {
+            break;
+        } else {
+            usleep(1000);
+        }
+    }
+    /* anything left was interrupted or lost with a vm */
+    skipped = 0;
+    for(i = shown; i < nfiles; i++) {
+        if(results[i].done)
+            showResult(i, &results[i]);
+        else
+            skipped++;
+    }
+    shown = nfiles - skipped;
+    if(nworkers < njobs)
+        printf("%d of %d vms failed\n", njobs - nworkers, njobs);
+    if(skipped)
+        printf("%ld inputs not run\n", (long)skipped);
 
     gettimeofday(&now, 0);
-    printf("boot time:  %.2f\n", timeDelta(&startBoot, &startTest));
-    printf("test time:  %.2f\n", timeDelta(&startTest, &now));
-    printf("total time: %.2f\n", timeDelta(&startBoot, &now));
-    if(i != 0) {
-        printf("tests:     %d\n", i);
-        printf("execs/sec: %.2f\n", i / timeDelta(&startTest, &now));
+    total = timeDelta(&startBoot, &now);
+    boot = bootSecs();
+    printf("boot time:  %.2f\n", boot);
+    printf("test time:  %.2f\n", total - boot);
+    printf("total time: %.2f\n", total);
+    if(shown != 0) {
+        printf("vms:       %d\n", njobs);
+        printf("tests:     %ld\n", (long)shown);
+        if(nCached)
+            printf("cached:    %d\n", nCached);
+        printf("execs/sec: %.2f\n", nlat / (total - boot));
+        if(nlat) {
+            latencies(&p50, &p90, &p99, &max);
+            printf("latency:   p50 %.2f  p90 %.2f  p99 %.2f  max %.2f ms\n", p50 / 1000.0, p90 / 1000.0, p99 / 1000.0, max / 1000.0);
+        }
+        if(calN)
+            printf("timeout:   %d ms, calibrated as %g x p99 of the first %ld inputs\n", queue->timeoutMs, calK, (long)calN);
+        else
+            printf("timeout:   %d ms\n", queue->timeoutMs);
+        showNear();
+        showRejects(shown);
+        showBuckets();
+        showMap();
+        if(stabRuns > 1)
+            showStability(shown);
+        if(crashes)
+            showCrashes();
     }
-
-    shmctl(id, IPC_RMID, NULL);
+    if(jsonFp)
+        jsonSummary(1);
+    if(useCache)
+        cacheClose();
     return 0;
 }
-
-
@@ -0,0 +1,243 @@
+/*
+ * Start a program under an AFL fork server and run test cases in it,
+ * playing the part of afl-fuzz.  Each VM gets its own pipes, shared
+ * memory map and input file, so several can run side by side.
+ *
+ * With captureConsole, the program's output (the VM's serial console)
+ * goes to a file per VM, and the output from the last test can be
+ * read back with vmConsole.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "tafl.h"
+
+#define FUZZFN ".fuzzdat"
+#define CONFN ".console"
+
+int timeoutMs = 2000;
+size_t mapSize = MAP_SIZE;
+int captureConsole = 0;
+
+static int workpid = -1;
+static volatile int timedOut;
+
+void xperror(int cond, char *msg) {
+    if(cond) {
+        perror(msg);
+        exit(1);
+    }
+}
+
+double timeDelta(struct timeval *start, struct timeval *end)
+{
+    struct timeval d;
+
+    timersub(end, start, &d);
+    return d.tv_sec + d.tv_usec / 1000000.0;
+}
+
+void copyFile(char *dst, char *src) {
+    char buf[4096];
+    size_t n;
+    FILE *o = fopen(dst, "w");
+    FILE *i = fopen(src, "r");
+
+    xperror(!o, dst);
+    xperror(!i, src);
+    while((n = fread(buf, 1, sizeof buf, i)) > 0)
+        fwrite(buf, 1, n, o);
+    fclose(i);
+    fclose(o);
+}
+
+/* arm (or with ms 0, disarm) the timeout */
+static void
+setTimer(int ms)
+{
+    struct itimerval it;
+
+    memset(&it, 0, sizeof it);
+    it.it_value.tv_sec = ms / 1000;
+    it.it_value.tv_usec = (ms % 1000) * 1000;
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+static void
+alarmHandler(int sig)
+{
+    if(workpid != -1) {
+        kill(workpid, SIGKILL);
+        timedOut = 1;
+    }
+}
+
+/* boot the program in argv, returning -1 if its fork server doesn't start */
+int
+vmStart(struct vm *v, int id, char **argv)
+{
+    struct timeval start, end;
+    char idbuf[20], szbuf[20], buf[4], **args;
+    int ctl[2], st[2], i, n, x;
+
+    memset(v, 0, sizeof *v);
+    v->id = id;
+    v->con = -1;
+    if(id == 0) {
+        snprintf(v->fuzzFn, sizeof v->fuzzFn, "%s", FUZZFN);
+        snprintf(v->conFn, sizeof v->conFn, "%s", CONFN);
+    } else {
+        snprintf(v->fuzzFn, sizeof v->fuzzFn, "%s.%d", FUZZFN, id);
+        snprintf(v->conFn, sizeof v->conFn, "%s.%d", CONFN, id);
+    }
+    if(captureConsole) {
+        v->con = open(v->conFn, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        xperror(v->con == -1, v->conFn);
+    }
+
+    for(n = 0; argv[n]; n++)
+        continue;
+    args = calloc(n + 1, sizeof args[0]);
+    xperror(!args, "calloc");
+    for(i = 0; i < n; i++)
+        args[i] = strcmp(argv[i], "@@") == 0 ? v->fuzzFn : argv[i];
+
+    v->shmid = shmget(IPC_PRIVATE, mapSize, IPC_CREAT | IPC_EXCL | 0600);
+    xperror(v->shmid == -1, "shmget");
+    v->map = shmat(v->shmid, NULL, 0);
+    xperror(v->map == (void *)-1, "shmat");
+    /* the segment goes away when everyone detaches */
+    shmctl(v->shmid, IPC_RMID, NULL);
+    sprintf(idbuf, "%d", v->shmid);
+    sprintf(szbuf, "%ld", (long)mapSize);
+
+    x = pipe(ctl);
+    xperror(x == -1, "pipe1");
+    x = pipe(st);
+    xperror(x == -1, "pipe2");
+
+    gettimeofday(&start, NULL);
+    v->pid = fork();
+    xperror(v->pid == -1, "fork");
+    if(v->pid == 0) {
+        dup2(ctl[0], FORKSRV_FD);
+        dup2(st[1], FORKSRV_FD + 1);
+        close(ctl[0]);
+        close(ctl[1]);
+        close(st[0]);
+        close(st[1]);
+        if(v->con != -1) {
+            dup2(v->con, 1);
+            dup2(v->con, 2);
+            close(v->con);
+        }
+        setenv("__AFL_SHM_ID", idbuf, 1);
+        setenv("AFL_MAP_SIZE", szbuf, 1);
+        execvp(args[0], args);
+        xperror(1, args[0]);
+    }
+    close(ctl[0]);
+    close(st[1]);
+    signal(SIGPIPE, SIG_IGN);
+    v->ctl = ctl[1];
+    v->st = st[0];
+    free(args);
+
+    do {
+        x = read(v->st, buf, 4);
+    } while(x == -1 && errno == EINTR);
+    gettimeofday(&end, NULL);
+    v->bootSecs = timeDelta(&start, &end);
+    return x == 4 ? 0 : -1;
+}
+
+/* run one test case, returning -1 if the fork server went away */
+int
+vmRun(struct vm *v, char *fname, struct result *r)
+{
+    struct timeval start, end;
+    int status, x;
+
+    copyFile(v->fuzzFn, fname);
+    memset(v->map, 0, mapSize);
+    if(v->con != -1)
+        v->conOff = lseek(v->con, 0, SEEK_END);
+
+    signal(SIGALRM, alarmHandler);
+    timedOut = 0;
+    gettimeofday(&start, NULL);
+    x = write(v->ctl, "GOGO", 4);
+    if(x != 4)
+        return -1;
+    x = read(v->st, &workpid, 4);
+    if(x != 4) {
+        workpid = -1;
+        return -1;
+    }
+    setTimer(timeoutMs);
+    do {
+        x = read(v->st, &status, 4);
+    } while(x == -1 && errno == EINTR);
+    setTimer(0);
+    workpid = -1;
+    gettimeofday(&end, NULL);
+    if(x != 4)
+        return -1;
+
+    r->vm = v->id;
+    r->status = status;
+    r->timedOut = timedOut;
+    r->secs = timeDelta(&start, &end);
+    covMask(v->map);
+    r->edges = covCount(v->map, mapSize, r->buckets);
+    return 0;
+}
+
+/*
+ * Read the console output from the last test into buf, keeping the
+ * end if there is too much, and returning its length.
+ */
+size_t
+vmConsole(struct vm *v, char *buf, size_t sz)
+{
+    off_t start, end;
+    ssize_t n;
+
+    buf[0] = 0;
+    if(v->con == -1 || sz == 0)
+        return 0;
+    end = lseek(v->con, 0, SEEK_END);
+    start = v->conOff;
+    if(end - start > (off_t)(sz - 1))
+        start = end - (sz - 1);
+    n = pread(v->con, buf, end - start, start);
+    if(n < 0)
+        n = 0;
+    buf[n] = 0;
+    return n;
+}
+
+/* shut down the fork server, returning its exit status */
+int
+vmStop(struct vm *v)
+{
+    int status = 0;
+
+    close(v->ctl);
+    close(v->st);
+    waitpid(v->pid, &status, 0);
+    shmdt(v->map);
+    if(v->con != -1)
+        close(v->con);
+    return status;
+}
@@ -1,19 +1,32 @@
 /*
  * AFL hypercalls
  *
- * Compile with -DTEST to take inputs from stdin without using hypercalls.
+ * Set aflTestMode to take inputs from stdin without using hypercalls,
+ * or aflNative to talk to AFL directly with its fork server protocol.
  */
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
 #include "drv.h"
+#include "sysc.h"
 
 int aflTestMode = 0;
+int aflNative = 0;
+char *aflInputFile = NULL;
 
+/* work buffer size, can be changed before the first call */
 #define SZ 4096
+u_long aflBufSize = SZ - 2 * sizeof(u_int64_t);
+int aflTruncated = 0;
+
 static u_long bufsz;
 static char *buf;
 static u_int64_t *arr;
@@ -22,27 +35,167 @@ static void
 aflInit(void)
 {
     static int aflInit = 0;
+    size_t mapsz;
     char *pg;
 
     if(aflInit)
         return;
 
+    /*
+     * the startWork range and work buffer share one mapping.
+     * There is room for one extra byte of input so getWork
+     * can tell when an input didn't fit.
+     */
+    mapsz = (2 * sizeof arr[0] + aflBufSize + 1 + SZ - 1) & ~(size_t)(SZ - 1);
+
     // XXX OpenBSD wont let us lock down the page in phys mem.
     // this may cause problem if our program ever gets swapped or moved!
-    pg = mmap(NULL, SZ, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    pg = mmap(NULL, mapsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     if(pg == (void*)-1) {
         perror("mmap");
         exit(1);
     }
-    memset(pg, 0, SZ); // touch all the bits!
+    memset(pg, 0, mapsz); // touch all the bits!
 
     arr = (u_int64_t *)pg;
     buf = pg + 2 * sizeof arr[0];
-    bufsz = SZ - 2 * sizeof arr[0];
+    bufsz = aflBufSize;
 
     aflInit = 1;
 }
 
+/* read until sz bytes or EOF */
+static u_long
+readAll(int fd, char *p, u_long sz)
+{
+    ssize_t n;
+    u_long tot;
+
+    for(tot = 0; tot < sz; tot += n) {
+        n = read(fd, p + tot, sz - tot);
+        if(n <= 0)
+            break;
+    }
+    return tot;
+}
+
+/*
+ * Native backend.
+ *
+ * Instead of hypercalls, run the standard AFL fork server on
+ * FORKSRV_FD and read inputs from a file or stdin, so the driver can
+ * be fuzzed at native speed.  When built with gcc's
+ * -fsanitize-coverage=trace-pc (see driver-afl in the Makefile) edges
+ * are recorded in the map named by __AFL_SHM_ID while startWork is
+ * tracing the driver itself, the same way QEMU records them.
+ */
+#define FORKSRV_FD 198
+#define MAPSZ (1 << 16)
+
+static unsigned char *covMap;
+static u_long mapSize = MAPSZ;  /* or AFL_MAP_SIZE, a power of two */
+static u_long prevLoc;
+static int tracing;
+static volatile int *inKernel; /* set once system calls start, shared with the fork server */
+
+void
+__sanitizer_cov_trace_pc(void)
+{
+    u_long cur;
+
+    if(!tracing)
+        return;
+    /* relative to the image, so edges don't move with ASLR between runs */
+    cur = (u_long)__builtin_return_address(0) - (u_long)__sanitizer_cov_trace_pc;
+    cur = ((cur >> 4) ^ (cur << 8)) & (mapSize - 1);
+    covMap[cur ^ prevLoc]++;
+    prevLoc = cur >> 1;
+}
+
+static void
+nativeInit(void)
+{
+    char *id, *sz;
+    u_long x;
+
+    sz = getenv("AFL_MAP_SIZE");
+    if(sz) {
+        x = strtoul(sz, NULL, 0);
+        if(x >= 256 && (x & (x - 1)) == 0)
+            mapSize = x;
+    }
+    covMap = (void*)-1;
+    id = getenv("__AFL_SHM_ID");
+    if(id)
+        covMap = shmat(atoi(id), NULL, 0);
+    if(covMap == (void*)-1)
+        covMap = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    inKernel = mmap(NULL, sizeof *inKernel, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(covMap == (void*)-1 || inKernel == (void*)-1) {
+        perror("mmap");
+        exit(1);
+    }
+}
+
+/* returns in a forked child for each input AFL asks for */
+static int
+nativeForkserver(void)
+{
+    u_int32_t msg;
+    pid_t pid;
+    int status;
+
+    nativeInit();
+    msg = 0;
+    if(write(FORKSRV_FD + 1, &msg, 4) != 4)
+        return 0; /* not run from AFL, just run once */
+
+    for(;;) {
+        if(read(FORKSRV_FD, &msg, 4) != 4)
+            exit(0);
+        *inKernel = 0;
+        refillChildPool();
+        pid = fork();
+        if(pid == -1) {
+            perror("fork");
+            exit(1);
+        }
+        if(pid == 0) {
+            close(FORKSRV_FD);
+            close(FORKSRV_FD + 1);
+            return 0;
+        }
+        if(write(FORKSRV_FD + 1, &pid, 4) != 4
+        || waitpid(pid, &status, 0) == -1)
+            exit(1);
+        /* like watcher(), dying while making system calls is not a driver bug */
+        if(*inKernel && WIFSIGNALED(status))
+            status = 0;
+        if(write(FORKSRV_FD + 1, &status, 4) != 4)
+            exit(1);
+    }
+}
+
+static u_long
+nativeRead(char *p, u_long sz)
+{
+    u_long n;
+    int fd;
+
+    if(!aflInputFile) {
+        lseek(0, 0, SEEK_SET); /* AFL reuses the same stdin for each input */
+        return readAll(0, p, sz);
+    }
+    fd = open(aflInputFile, O_RDONLY);
+    if(fd == -1) {
+        perror(aflInputFile);
+        exit(1);
+    }
+    n = readAll(fd, p, sz);
+    close(fd);
+    return n;
+}
+
 static inline u_long
 aflCall(u_long a0, u_long a1, u_long a2)
 {
@@ -60,6 +213,8 @@ startForkserver(int ticks)
     aflInit();
     if(aflTestMode)
         return 0;
+    if(aflNative)
+        return nativeForkserver();
     return aflCall(1, ticks, 0);
 }
 
@@ -68,9 +223,26 @@ getWork(u_long *sizep)
 {
     aflInit();
     if(aflTestMode)
-        *sizep = read(0, buf, bufsz);
+        *sizep = readAll(0, buf, bufsz + 1);
+    else if(aflNative)
+        *sizep = nativeRead(buf, bufsz + 1);
     else
-        *sizep = aflCall(2, (u_long)buf, bufsz);
+        *sizep = aflCall(2, (u_long)buf, bufsz + 1);
+    aflTruncated = (*sizep > bufsz);
+    if(aflTruncated)
+        *sizep = bufsz;
+    return buf;
+}
+
+/*
+ * the work buffer and its size, for callers that fill it themselves.
+ * There is room for one byte more than *sizep.
+ */
+char *
+workBuf(u_long *sizep)
+{
+    aflInit();
+    *sizep = bufsz;
     return buf;
 }
 
@@ -81,6 +253,14 @@ startWork(u_int64_t start, u_int64_t end)
     aflInit();
     if(aflTestMode)
         return 0;
+    if(aflNative) {
+        /* we can only trace ourselves */
+        tracing = (start <= (u_long)startWork && (u_long)startWork < end);
+        if(!tracing && inKernel)
+            *inKernel = 1;
+        prevLoc = 0;
+        return 0;
+    }
     arr[0] = start;
     arr[1] = end;
     return aflCall(3, (u_long)arr, 0);
@@ -92,6 +272,10 @@ doneWork(int val)
     aflInit();
     if(aflTestMode)
         return 0;
+    if(aflNative) {
+        fflush(stdout);
+        exit(val);
+    }
     return aflCall(4, (u_long)val, 0);
 }
 
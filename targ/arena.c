@@ -0,0 +1,119 @@
+/*
+ * Per-exec argument memory.
+ *
+ * Arguments are carved out of a bump arena that is mapped and
+ * pre-faulted before the fork server starts, so each forked copy
+ * does the same, small amount of copy-on-write work.  Large requests
+ * get their own anonymous mapping, which the kernel zeroes lazily,
+ * instead of malloc plus memset.  Everything is charged against a
+ * per-exec budget so pathological sizes fail fast.
+ *
+ * Nothing is ever freed - exit/doneWork are perfect GCs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include "drv.h"
+
+#define ALIGN 16
+#define BIGALLOC (64 * 1024)
+
+static char *arena, *cur, *end;
+static size_t budget, used;
+
+/* big allocations, so arenaReset can unmap them */
+static struct bigAlloc {
+    void *p;
+    size_t sz;
+} *big;
+static int nbig, maxbig;
+
+int
+arenaInit(size_t sz, size_t limit)
+{
+    if(arena)
+        return 0;
+
+    sz = (sz + 4095) & ~(size_t)4095;
+    arena = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(arena == (void*)-1) {
+        perror("mmap arena");
+        exit(1);
+    }
+    memset(arena, 0, sz); // touch all the bits!
+    cur = arena;
+    end = arena + sz;
+    budget = limit;
+    used = 0;
+    return 0;
+}
+
+/* return sz bytes of zeroed memory, or NULL if over budget */
+void *
+arenaAlloc(size_t sz)
+{
+    struct bigAlloc *nb;
+    void *p;
+    size_t asz;
+
+    if(!arena)
+        arenaInit(ARENASZ, ARENABUDGET);
+    if(sz > budget - used)
+        return NULL;
+    used += sz;
+
+    asz = (sz + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    if(sz < BIGALLOC && asz <= (size_t)(end - cur)) {
+        p = cur;
+        cur += asz;
+        return p;
+    }
+    if(nbig == maxbig) {
+        nb = realloc(big, (maxbig ? maxbig * 2 : 64) * sizeof big[0]);
+        if(!nb)
+            return NULL;
+        big = nb;
+        maxbig = maxbig ? maxbig * 2 : 64;
+    }
+    p = mmap(NULL, sz ? sz : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == (void*)-1)
+        return NULL;
+    big[nbig].p = p;
+    big[nbig].sz = sz ? sz : 1;
+    nbig++;
+    return p;
+}
+
+/*
+ * free everything, for callers that parse many inputs in one process.
+ * Not needed in the driver, where each test case gets a fresh copy.
+ */
+void
+arenaReset(void)
+{
+    int i;
+
+    if(!arena)
+        return;
+    memset(arena, 0, cur - arena);
+    cur = arena;
+    used = 0;
+    for(i = 0; i < nbig; i++)
+        munmap(big[i].p, big[i].sz);
+    nbig = 0;
+}
+
+char *
+arenaStrdup(const char *s)
+{
+    size_t sz = strlen(s) + 1;
+    char *p;
+
+    p = arenaAlloc(sz);
+    if(p)
+        memcpy(p, s, sz);
+    return p;
+}
@@ -3,61 +3,79 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#ifdef __OpenBSD__
 #include <sys/event.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 #include "drv.h"
 #include "sysc.h"
 
-int getStdFile(int typ)
+/*
+ * make a new file of the given type.  For pipes and socketpairs
+ * the other end is returned in peer, and is otherwise -1.  If dry
+ * is set nothing is made, and STUBFD is returned for the types the
+ * driver can make on OpenBSD.
+ */
+static int mkStdFile(int typ, int *peer, int dry)
 {
     int fd, pipes[2];
 
     fd = -1;
+    *peer = -1;
     switch(typ) {
-#define F(n, fn, flg) case n: fd = open(fn, flg); break;
+#define F(n, fn, flg) case n: fd = dry ? STUBFD : open(fn, flg); break;
     F(0, "/", O_RDONLY);
-#define S(n, a,b,c) case n: fd = socket(a, b, c); break;
+#define S(n, a,b,c) case n: fd = dry ? STUBFD : socket(a, b, c); break;
+/* sockets OpenBSD doesn't have, which are still tried elsewhere */
+#define X(n, a,b,c) case n: fd = dry ? -1 : socket(a, b, c); break;
     S(1, AF_INET, SOCK_STREAM, 0);
     S(2, AF_INET, SOCK_DGRAM, 0);
     S(3, AF_UNIX, SOCK_STREAM, 0);
     S(4, AF_UNIX, SOCK_DGRAM, 0);
 
     case 5: 
+        if(dry) return STUBFD;
         if(pipe(pipes) == -1) return -1;
         fd = pipes[0];
+        *peer = pipes[1];
         break;
     case 6:
+        if(dry) return STUBFD;
         if(pipe(pipes) == -1) return -1;
         fd = pipes[1];
+        *peer = pipes[0];
         break;
 
     S(7, AF_UNIX, SOCK_STREAM, 0);
     S(8, AF_UNIX, SOCK_DGRAM, 0);
     S(9, AF_UNIX, SOCK_SEQPACKET, 0);
-    S(10, AF_UNIX, SOCK_RAW, 0);
-    S(11, AF_UNIX, SOCK_RDM, 0);
+    X(10, AF_UNIX, SOCK_RAW, 0);
+    X(11, AF_UNIX, SOCK_RDM, 0);
     S(12, AF_INET, SOCK_STREAM, 0);
     S(13, AF_INET, SOCK_DGRAM, 0);
-    S(14, AF_INET, SOCK_SEQPACKET, 0);
+    X(14, AF_INET, SOCK_SEQPACKET, 0);
     S(15, AF_INET, SOCK_RAW, 0);
-    S(16, AF_INET, SOCK_RDM, 0);
+    X(16, AF_INET, SOCK_RDM, 0);
     S(17, AF_INET6, SOCK_STREAM, 0);
     S(18, AF_INET6, SOCK_DGRAM, 0);
-    S(19, AF_INET6, SOCK_SEQPACKET, 0);
+    X(19, AF_INET6, SOCK_SEQPACKET, 0);
     S(20, AF_INET6, SOCK_RAW, 0);
-    S(21, AF_INET6, SOCK_RDM, 0);
-    S(22, AF_IPX, SOCK_STREAM, 0);
-    S(23, AF_IPX, SOCK_DGRAM, 0);
-    S(24, AF_IPX, SOCK_SEQPACKET, 0);
-    S(25, AF_IPX, SOCK_RAW, 0);
-    S(26, AF_IPX, SOCK_RDM, 0);
-    S(27, AF_APPLETALK, SOCK_STREAM, 0);
-    S(28, AF_APPLETALK, SOCK_DGRAM, 0);
-    S(29, AF_APPLETALK, SOCK_SEQPACKET, 0);
-    S(30, AF_APPLETALK, SOCK_RAW, 0);
-    S(31, AF_APPLETALK, SOCK_RDM, 0);
-
-#define SP(n, f, ty, idx) case n: socketpair(f, ty, 0, pipes); fd = pipes[idx]; break
+    X(21, AF_INET6, SOCK_RDM, 0);
+    X(22, AF_IPX, SOCK_STREAM, 0);
+    X(23, AF_IPX, SOCK_DGRAM, 0);
+    X(24, AF_IPX, SOCK_SEQPACKET, 0);
+    X(25, AF_IPX, SOCK_RAW, 0);
+    X(26, AF_IPX, SOCK_RDM, 0);
+    X(27, AF_APPLETALK, SOCK_STREAM, 0);
+    X(28, AF_APPLETALK, SOCK_DGRAM, 0);
+    X(29, AF_APPLETALK, SOCK_SEQPACKET, 0);
+    X(30, AF_APPLETALK, SOCK_RAW, 0);
+    X(31, AF_APPLETALK, SOCK_RDM, 0);
+
+#define SP(n, f, ty, idx) case n: if(dry) return STUBFD; if(socketpair(f, ty, 0, pipes) == -1) return -1; fd = pipes[idx]; *peer = pipes[1-idx]; break
     SP(32, AF_UNIX, SOCK_STREAM, 0);
     SP(33, AF_UNIX, SOCK_STREAM, 1);
     SP(34, AF_UNIX, SOCK_DGRAM, 0);
@@ -66,7 +84,12 @@ int getStdFile(int typ)
     SP(37, AF_UNIX, SOCK_SEQPACKET, 1);
 
     case 38:
+        if(dry) return STUBFD;
+#if defined(__OpenBSD__)
         fd = kqueue();
+#elif defined(__linux__)
+        fd = epoll_create1(0); /* closest thing to a kqueue */
+#endif
         break;
 
     default:
@@ -80,3 +103,56 @@ int getStdFile(int typ)
     return fd;
 }
 
+#define NSTDFILE 39
+
+/*
+ * In pool mode one file of every type is made before the fork
+ * server starts and test cases get a dup of it, so that creating
+ * sockets and pipes isn't done (or traced) on every exec.
+ */
+static int pool[NSTDFILE];
+static int usePool = 0;
+
+/*
+ * move a pooled fd up to POOLFD or above to keep the low descriptor
+ * numbers that test cases expect free.
+ */
+int poolFd(int fd)
+{
+    int hi;
+
+    if(fd == -1)
+        return -1;
+    hi = fcntl(fd, F_DUPFD, POOLFD);
+    if(hi == -1)
+        hi = fd;
+    else
+        close(fd);
+    fcntl(hi, F_SETFD, FD_CLOEXEC);
+    return hi;
+}
+
+void initStdFilePool(void)
+{
+    int typ, peer;
+
+    for(typ = 0; typ < NSTDFILE; typ++) {
+        pool[typ] = poolFd(mkStdFile(typ, &peer, 0));
+        poolFd(peer); /* keep it open, but out of the way */
+    }
+    usePool = 1;
+}
+
+int getStdFile(int typ)
+{
+    int peer;
+
+    if(sysStubs)
+        return mkStdFile(typ, &peer, 1);
+    if(usePool) {
+        if(typ < 0 || typ >= NSTDFILE || pool[typ] == -1)
+            return -1;
+        return dup(pool[typ]);
+    }
+    return mkStdFile(typ, &peer, 0);
+}
@@ -0,0 +1,273 @@
+/*
+ * Batch mode.
+ *
+ * Run many inputs in one process launch.  Each input runs in its own
+ * forked child with a timeout and a one line result record is
+ * written for each input.  Inputs come from the files in a directory
+ * or from stdin as a stream of 32-bit big-endian lengths each
+ * followed by that many bytes.  The child's stdin is /dev/null, and
+ * temp files left by earlier inputs are removed before it runs.
+ */
+
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "drv.h"
+#include "sysc.h"
+
+static pid_t workpid = -1;
+static int timedOut;
+static char *rejNames[NREJ] = REJNAMES;
+
+static void
+alarmHandler(int sig)
+{
+    if(workpid > 0) {
+        kill(workpid, SIGKILL);
+        timedOut = 1;
+    }
+}
+
+/* read until sz bytes or EOF, returning how many were read */
+static ssize_t
+readAll(int fd, char *buf, size_t sz)
+{
+    ssize_t n;
+    size_t tot;
+
+    for(tot = 0; tot < sz; tot += n) {
+        n = read(fd, buf + tot, sz - tot);
+        if(n == -1 && errno == EINTR)
+            n = 0;
+        else if(n == -1)
+            return -1;
+        else if(n == 0)
+            break;
+    }
+    return tot;
+}
+
+/* read and discard sz bytes */
+static int
+skipBytes(int fd, size_t sz)
+{
+    char tmp[4096];
+    ssize_t n;
+
+    while(sz > 0) {
+        n = readAll(fd, tmp, sz < sizeof tmp ? sz : sizeof tmp);
+        if(n <= 0)
+            return -1;
+        sz -= n;
+    }
+    return 0;
+}
+
+static void
+putList(FILE *out, char *key, struct sysResult *res, int errs)
+{
+    int i;
+
+    fprintf(out, "\t%s=", key);
+    if(res->ncalls == 0)
+        fprintf(out, "-");
+    for(i = 0; i < res->ncalls; i++) {
+        if(errs)
+            fprintf(out, "%s%d", i ? "," : "", res->err[i]);
+        else
+            fprintf(out, "%s%ld", i ? "," : "", res->ret[i]);
+    }
+}
+
+/* buf holds sz bytes of input, and sz may be one past bufsz if it didn't fit */
+static void
+runOne(FILE *out, char *name, char *buf, u_long sz, u_long bufsz, int timeoutMs, runFunc run, struct sysResult *res)
+{
+    struct itimerval it;
+    struct timeval start, end, d;
+    int status, sig, fd;
+
+    memset(res, 0, sizeof *res);
+    res->parseOk = -1;
+    if(sz > bufsz) {
+        sz = bufsz;
+        res->truncated = 1;
+    }
+    refillChildPool();
+    fflush(stdout);
+    fflush(out);
+    gettimeofday(&start, NULL);
+    workpid = fork();
+    if(workpid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if(workpid == 0) {
+        /* workpid is 0 here, and kill(0, ...) would hit the whole group */
+        signal(SIGALRM, SIG_DFL);
+        /* keep test cases off the input stream, and out of each other's files */
+        fd = open("/dev/null", O_RDWR);
+        if(fd > 0) {
+            dup2(fd, 0);
+            close(fd);
+        }
+        cleanTmpFiles();
+        run(buf, sz, res);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    timedOut = 0;
+    memset(&it, 0, sizeof it);
+    it.it_value.tv_sec = timeoutMs / 1000;
+    it.it_value.tv_usec = (timeoutMs % 1000) * 1000;
+    setitimer(ITIMER_REAL, &it, NULL);
+    while(waitpid(workpid, &status, 0) == -1 && errno == EINTR)
+        continue;
+    memset(&it, 0, sizeof it);
+    setitimer(ITIMER_REAL, &it, NULL);
+    workpid = -1;
+    gettimeofday(&end, NULL);
+    timersub(&end, &start, &d);
+
+    sig = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    fprintf(out, "%s\tparse=%d\tfiltered=%d\tnrecs=%d", name, res->parseOk, res->filtered, res->nrecs);
+    putList(out, "ret", res, 0);
+    putList(out, "errno", res, 1);
+    if(res->reject > REJ_NONE && res->reject < NREJ)
+        fprintf(out, "\treject=%s\toff=%ld", rejNames[res->reject], res->rejOff);
+    else
+        fprintf(out, "\treject=-\toff=-");
+    fprintf(out, "\ttrunc=%d\tusec=%ld\tsig=%d\ttimeout=%d\n", res->truncated, (long)(d.tv_sec * 1000000 + d.tv_usec), sig, timedOut);
+}
+
+static int
+cmpName(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+static int
+runDir(FILE *out, char *dir, char *buf, u_long bufsz, int timeoutMs, runFunc run, struct sysResult *res)
+{
+    struct dirent *ent;
+    char **names, path[1024];
+    size_t n, max, i;
+    ssize_t sz;
+    DIR *d;
+    int fd;
+
+    d = opendir(dir);
+    if(!d) {
+        perror(dir);
+        return 1;
+    }
+    n = 0;
+    max = 256;
+    names = malloc(max * sizeof names[0]);
+    while(names && (ent = readdir(d)) != NULL) {
+        if(ent->d_name[0] == '.')
+            continue;
+        if(n == max) {
+            max *= 2;
+            names = realloc(names, max * sizeof names[0]);
+            if(!names)
+                break;
+        }
+        names[n++] = strdup(ent->d_name);
+    }
+    closedir(d);
+    if(!names) {
+        perror("malloc");
+        return 1;
+    }
+    qsort(names, n, sizeof names[0], cmpName);
+
+    for(i = 0; i < n; i++) {
+        snprintf(path, sizeof path, "%s/%s", dir, names[i]);
+        fd = open(path, O_RDONLY);
+        if(fd == -1) {
+            perror(path);
+            continue;
+        }
+        sz = readAll(fd, buf, bufsz + 1);
+        close(fd);
+        if(sz == -1) {
+            perror(path);
+            continue;
+        }
+        runOne(out, path, buf, sz, bufsz, timeoutMs, run, res);
+    }
+    return 0;
+}
+
+static int
+runStream(FILE *out, char *buf, u_long bufsz, int timeoutMs, runFunc run, struct sysResult *res)
+{
+    unsigned char hdr[4];
+    char name[32];
+    u_long sz, rsz;
+    int n;
+
+    for(n = 0; readAll(0, (char *)hdr, 4) == 4; n++) {
+        sz = ((u_long)hdr[0] << 24) | (hdr[1] << 16) | (hdr[2] << 8) | hdr[3];
+        rsz = sz <= bufsz ? sz : bufsz + 1;
+        if(readAll(0, buf, rsz) != (ssize_t)rsz
+        || skipBytes(0, sz - rsz) == -1) {
+            fprintf(stderr, "short input %d\n", n);
+            return 1;
+        }
+        snprintf(name, sizeof name, "#%d", n);
+        runOne(out, name, buf, rsz, bufsz, timeoutMs, run, res);
+    }
+    return 0;
+}
+
+int
+runBatch(char *src, char *outFn, int timeoutMs, runFunc run)
+{
+    struct sysResult *res;
+    struct sigaction sa;
+    u_long bufsz;
+    char *buf;
+    FILE *out;
+    int ret;
+
+    out = stdout;
+    if(strcmp(outFn, "-") != 0) {
+        out = fopen(outFn, "w");
+        if(!out) {
+            perror(outFn);
+            return 1;
+        }
+    }
+
+    /* results are filled in by the child */
+    res = mmap(NULL, sizeof *res, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(res == (void*)-1) {
+        perror("mmap");
+        return 1;
+    }
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = alarmHandler;
+    sigaction(SIGALRM, &sa, NULL);
+
+    buf = workBuf(&bufsz);
+    if(strcmp(src, "-") == 0)
+        ret = runStream(out, buf, bufsz, timeoutMs, run, res);
+    else
+        ret = runDir(out, src, buf, bufsz, timeoutMs, run, res);
+    fflush(out);
+    if(out != stdout)
+        fclose(out);
+    return ret;
+}
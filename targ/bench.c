@@ -0,0 +1,293 @@
+/*
+ * Parser microbenchmarks.
+ *
+ * Load a corpus into memory once and time the parser over it in a
+ * tight loop with args that have side effects stubbed out.  Results
+ * are written as one JSON object per line so runs from different
+ * revisions can be compared.
+ *
+ * ./bench [-l label] [-t secs] inputs
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "drv.h"
+#include "sysc.h"
+
+int verbose = 0;
+
+static char *argNames[NARGTYPES] = {
+    "Num", "Alloc", "Buf", "Len", "File", "StdFile",
+    NULL, "Vec64", "Filename", "Pid", "Ref", "Vec32",
+};
+
+struct input {
+    unsigned char *buf;
+    size_t sz;
+};
+
+static struct input *corpus;
+static size_t ncorpus, maxcorpus, corpusBytes;
+static char *label = NULL;
+static double minTime = 1.0;
+static volatile u_int64_t sink;
+
+static void
+usage(char *prog)
+{
+    printf("usage:  %s [-l label] [-t secs] file-or-dir ...\n", prog);
+    printf("\t\t-l label\tadd label to every result\n");
+    printf("\t\t-t secs\t\tminimum time to run each benchmark (default 1)\n");
+    exit(1);
+}
+
+static void
+addFile(char *fn)
+{
+    struct stat st;
+    int fd;
+
+    fd = open(fn, O_RDONLY);
+    if(fd == -1 || fstat(fd, &st) == -1) {
+        perror(fn);
+        exit(1);
+    }
+    if(ncorpus == maxcorpus) {
+        maxcorpus = maxcorpus ? maxcorpus * 2 : 1024;
+        corpus = realloc(corpus, maxcorpus * sizeof corpus[0]);
+    }
+    corpus[ncorpus].sz = st.st_size;
+    corpus[ncorpus].buf = malloc(st.st_size + 1);
+    if(!corpus || !corpus[ncorpus].buf
+    || read(fd, corpus[ncorpus].buf, st.st_size) != st.st_size) {
+        perror(fn);
+        exit(1);
+    }
+    close(fd);
+    corpusBytes += st.st_size;
+    ncorpus++;
+}
+
+static void
+addPath(char *path)
+{
+    struct dirent *ent;
+    char fn[1024];
+    DIR *d;
+
+    d = opendir(path);
+    if(!d) {
+        addFile(path);
+        return;
+    }
+    while((ent = readdir(d)) != NULL) {
+        if(ent->d_name[0] == '.')
+            continue;
+        snprintf(fn, sizeof fn, "%s/%s", path, ent->d_name);
+        addFile(fn);
+    }
+    closedir(d);
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static u_int64_t
+nsClock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * parse every input the same way the driver does.  The driver gets
+ * a fresh arena with every fork, so only the parsing is added to
+ * parseNs, not arenaReset.  An empty region timed the same way after
+ * each parse is taken out as the cost of the clock reads.
+ */
+static u_int64_t parseNs;
+
+static void
+passParse(void)
+{
+    struct sysRec recs[MAXCALLS];
+    struct slice b;
+    u_int64_t start, stop;
+    size_t i;
+    int n;
+
+    for(i = 0; i < ncorpus; i++) {
+        arenaReset();
+        mkSlice(&b, corpus[i].buf, corpus[i].sz);
+        start = nsClock();
+        sink += parseSysRecArr(&b, MAXCALLS, recs, &n);
+        stop = nsClock();
+        parseNs += (stop - start) - (nsClock() - stop);
+    }
+}
+
+/* just split every input into records and buffers */
+static void
+passDelims(void)
+{
+    struct slice b, recs[MAXCALLS], bufs[NSLICES];
+    size_t i, j, nrecs, nbufs;
+
+    for(i = 0; i < ncorpus; i++) {
+        mkSlice(&b, corpus[i].buf, corpus[i].sz);
+        indexDelims(&b, CALLDELIM, BUFDELIM, sizeof CALLDELIM-1);
+        if(getDelimSlices(&b, CALLDELIM, sizeof CALLDELIM-1, MAXCALLS, recs, &nrecs) == -1)
+            continue;
+        for(j = 0; j < nrecs; j++) {
+            if(getDelimSlices(recs + j, BUFDELIM, sizeof BUFDELIM-1, NSLICES, bufs, &nbufs) == 0)
+                sink += nbufs;
+        }
+    }
+}
+
+/* read every input as a sequence of 64-bit numbers */
+static void
+passU64(void)
+{
+    struct slice b;
+    u_int64_t x;
+    size_t i;
+
+    for(i = 0; i < ncorpus; i++) {
+        mkSlice(&b, corpus[i].buf, corpus[i].sz);
+        while(getU64(&b, &x) == 0)
+            sink += x;
+    }
+}
+
+/* run pass over the corpus until minTime is up, returning ns per pass */
+static double
+timePass(void (*pass)(void), u_int64_t *passes)
+{
+    double start, t;
+    u_int64_t n;
+
+    pass(); /* warm up */
+    n = 0;
+    start = now();
+    do {
+        pass();
+        n++;
+        t = now() - start;
+    } while(t < minTime);
+    *passes = n;
+    return t * 1e9 / n;
+}
+
+static void
+putHead(char *bench)
+{
+    printf("{\"bench\":\"%s\"", bench);
+    if(label)
+        printf(",\"label\":\"%s\"", label);
+}
+
+static void
+report(char *bench, double ns, u_int64_t passes, size_t ops)
+{
+    putHead(bench);
+    printf(",\"inputs\":%lu,\"bytes\":%lu,\"passes\":%llu", (u_long)ncorpus, (u_long)corpusBytes, (unsigned long long)passes);
+    printf(",\"ns_per_pass\":%.0f,\"inputs_per_sec\":%.1f,\"ns_per_input\":%.2f,\"ns_per_byte\":%.3f",
+        ns, ncorpus * 1e9 / ns, ns / ncorpus, ns / corpusBytes);
+    if(ops)
+        printf(",\"ops\":%lu,\"ns_per_op\":%.2f", (u_long)ops, ns / ops);
+    printf("}\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    struct slice b;
+    u_int64_t passes, x;
+    size_t i, nargs, nu64;
+    struct argStat *as;
+    double ns, clk;
+    int opt, typ;
+
+    while((opt = getopt(argc, argv, "l:t:")) != -1) {
+        switch(opt) {
+        case 'l':
+            if(strpbrk(optarg, "\"\\")) {
+                printf("bad label: %s\n", optarg);
+                exit(1);
+            }
+            label = optarg;
+            break;
+        case 't':
+            minTime = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if(optind == argc)
+        usage(argv[0]);
+    for(i = optind; i < (size_t)argc; i++)
+        addPath(argv[i]);
+    if(ncorpus == 0 || corpusBytes == 0) {
+        printf("empty corpus\n");
+        exit(1);
+    }
+
+    sysStubs = 1;
+    arenaInit(ARENASZ, ARENABUDGET);
+
+    /* count args per pass, and time each arg type */
+    argStatsOn = 1;
+    passParse();
+    nargs = 0;
+    for(typ = 0; typ < NARGTYPES; typ++)
+        nargs += argStats[typ].n;
+    memset(argStats, 0, sizeof argStats);
+    timePass(passParse, &passes);
+    argStatsOn = 0;
+
+    nu64 = 0;
+    for(i = 0; i < ncorpus; i++) {
+        mkSlice(&b, corpus[i].buf, corpus[i].sz);
+        while(getU64(&b, &x) == 0)
+            nu64++;
+    }
+
+    parseNs = 0;
+    timePass(passParse, &passes);
+    ns = (double)(int64_t)parseNs / (passes + 1);
+    report("parseSysRecArr", ns, passes, nargs);
+    ns = timePass(passDelims, &passes);
+    report("getDelimSlices", ns, passes, 0);
+    ns = timePass(passU64, &passes);
+    report("getU64", ns, passes, nu64);
+
+    /* nested args and the clock reads are taken out of the arg times */
+    for(typ = 0; typ < NARGTYPES; typ++) {
+        as = &argStats[typ];
+        if(!argNames[typ] || !as->n)
+            continue;
+        clk = argStatClock(typ);
+        ns = as->ns - as->n * clk;
+        putHead("parseArg");
+        printf(",\"type\":\"%s\",\"count\":%llu,\"bytes\":%llu,\"clock_ns\":%.0f", argNames[typ], as->n, as->bytes, clk);
+        printf(",\"ns_per_arg\":%.2f,\"ns_per_byte\":%.3f}\n", ns / as->n, ns / as->bytes);
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Values the driver passes to doneWork, which become the exit status
+ * of the test case seen by the fuzzer.  Shared with the host tools.
+ *
+ * The low 7 bits say why an input was rejected before any system call
+ * was made (REJ_NONE if it wasn't) and DONE_TRUNC is set if the input
+ * didn't fit in the work buffer.
+ */
+#define DONE_TRUNC 0x80 /* doneWork value for inputs that didn't fit */
+#define DONE_REJMASK 0x7f
+
+#define REJ_NONE 0
+#define REJ_CALLS 1     /* couldn't split input into call records */
+#define REJ_BUFS 2      /* couldn't split a call record into buffers */
+#define REJ_SHORT 3     /* input ended in the middle of a value */
+#define REJ_ARGTYPE 4   /* unknown argument type */
+#define REJ_NOBUF 5     /* ran out of buffers for Buf/File/Filename args */
+#define REJ_STKOVER 6   /* size stack overflow */
+#define REJ_STKUNDER 7  /* Len with nothing on the size stack */
+#define REJ_ALLOC 8     /* argument memory over budget */
+#define REJ_STDFILE 9   /* bad or failed StdFile */
+#define REJ_PID 10      /* bad Pid type or fork failed */
+#define REJ_REF 11      /* Ref to a later call or bad arg */
+#define REJ_FILTER 12   /* call filter (-f) */
+#define REJ_EXEC 13     /* executor can't run one of the calls */
+#define NREJ 14
+
+#define REJNAMES { \
+    "none", "calls", "bufs", "short", "argtype", "nobuf", "stkover", \
+    "stkunder", "alloc", "stdfile", "pid", "ref", "filter", "exec", \
+}
@@ -2,6 +2,7 @@
  * Syscall driver
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,14 +13,25 @@
 #include "drv.h"
 #include "sysc.h"
 
-#define MAXFILTCALLS 10
-
 static void usage(char *prog) {
-    printf("usage:  %s [-tvx] [-f nr]*\n", prog);
-    printf("\t\t-f nr\tFilter out cases that dont make this call. Can be repeated\n");
+    printf("usage:  %s [-atvxPs] [-i file] [-A sz] [-B sz] [-L sz] [-p n] [-N prefix] [-c n] [-b src [-o out] [-w ms]] [-f spec]*\n", prog);
+    printf("\t\t-a\tuse the native AFL fork server instead of hypercalls\n");
+    printf("\t\t-A sz\tsize of pre-faulted argument arena (default %d)\n", ARENASZ);
+    printf("\t\t-B sz\tsize of the input buffer (default %ld)\n", aflBufSize);
+    printf("\t\t-b src\tbatch mode, run each file in directory src, or length-prefixed inputs from stdin if src is -\n");
+    printf("\t\t-c n\tfork n idle children before forking for child pid args\n");
+    printf("\t\t-f spec\tonly run calls in spec: nr, lo-hi, ^nr to deny, @file, comma separated. Can be repeated\n");
+    printf("\t\t-i file\twith -a, read inputs from file instead of stdin\n");
+    printf("\t\t-L sz\tlimit on argument memory per test case (default %d)\n", ARENABUDGET);
+    printf("\t\t-o out\twrite batch results to out (default stdout)\n");
+    printf("\t\t-N pre\tpath prefix for temp files (default /tmp/file)\n");
+    printf("\t\t-p n\tmake the first n temp files before forking\n");
+    printf("\t\t-P\tmake StdFiles before forking and dup them in test cases\n");
+    printf("\t\t-s\tidle children wait in sigsuspend and catch all signals\n");
     printf("\t\t-t\ttest mode, dont use AFL hypercalls\n");
     printf("\t\t-T\tenable qemu's timer in forked children\n");
     printf("\t\t-v\tverbose mode\n");
+    printf("\t\t-w ms\ttimeout for each batch input (default 1000)\n");
     printf("\t\t-x\tdon't perform system call\n");
     exit(1);
 }
@@ -41,68 +53,148 @@ static void watcher(void) {
 }
 
 static int
-parseU16(char *p, unsigned short *x)
+parseSize(char *p, size_t *x)
 {
     unsigned long val;
     char *endp;
 
-    val = strtoul(p, &endp, 10);
-    if(endp == p || *endp != 0
-    || val < 0 || val >= 65536)
+    val = strtoul(p, &endp, 0);
+    if(endp == p || *endp != 0)
         return -1;
     *x = val;
     return 0;
 }
 
-/* return true if we should execute this call */
-static int
-filterCalls(unsigned short *filtCalls, int nFiltCalls, struct sysRec *recs, int nrecs) 
+int verbose = 0;
+static char *rejNames[NREJ] = REJNAMES;
+
+static int noSyscall = 0;
+
+/* parse and run one input, recording what happened in res */
+static void
+runInput(char *buf, u_long sz, struct sysResult *res)
 {
-    int i, j, match;
-
-    /* all records should have calls on the filtCalls list */
-    for(i = 0; i < nrecs; i++) {
-        match = 0;
-        for(j = 0; j < nFiltCalls; j++) {
-            if(recs[i].nr == filtCalls[j])
-                match = 1;
+    struct sysRec recs[MAXCALLS];
+    struct slice slice;
+    long x;
+    int i;
+
+    /* trace our driver code while parsing workbuf */
+#ifdef __linux__
+    extern void _init(), _fini();
+    startWork((u_long)_init, (u_long)_fini);
+#else
+    extern void __init(), __fini();
+    startWork((u_long)__init, (u_long)__fini);
+#endif
+    mkSlice(&slice, buf, sz);
+    res->parseOk = parseSysRecArr(&slice, MAXCALLS, recs, &res->nrecs);
+    res->reject = rejReason;
+    res->rejOff = rejOff;
+    if(verbose) {
+        printf("read %ld bytes, parse result %d nrecs %d\n", sz, res->parseOk, res->nrecs);
+        if(res->parseOk == 0)
+            showSysRecArr(recs, res->nrecs);
+    }
+
+    if(res->parseOk == 0 && !validSysRecArr(recs, res->nrecs)) {
+        res->filtered = 1;
+        res->reject = REJ_EXEC;
+        if (verbose) printf("Rejected by %s executor\n", sysExec->name);
+    } else if(res->parseOk == 0) {
+        /* trace kernel code while performing syscalls */
+        startWork(0xffffffff81001000L, 0xffffffffffffffffL);
+        x = 0;
+        if(!noSyscall) {
+            /* note: if this crashes, watcher will do doneWork for us */
+            for(i = 0; i < res->nrecs; i++) {
+                errno = 0;
+                x = doSysRec(recs + i);
+                res->ret[i] = x;
+                res->err[i] = errno;
+                res->ncalls = i + 1;
+            }
         }
-        /* note: empty list is a match */
-        if(!match && nFiltCalls > 0) 
-            return 0;
+        if (verbose) printf("syscall returned %ld\n", x);
+    } else if(res->reject == REJ_FILTER) {
+        /* the parser checks the filter before making any args */
+        res->filtered = 1;
+        if (verbose) printf("Rejected by filter\n");
+    } else {
+        if (verbose) printf("Rejected by parser: %s at offset %ld\n", rejNames[res->reject], res->rejOff);
     }
-    return 1;
 }
 
-int verbose = 0;
-
 int
 main(int argc, char **argv)
 {
-    struct sysRec recs[3];
-    struct slice slice;
-    unsigned short filtCalls[MAXFILTCALLS];
-    char *prog, *buf;
+    struct sysResult res;
+    char *prog, *buf, *tmpPrefix = NULL;
+    char *batchSrc = NULL, *batchOut = "-";
+    size_t arenaSz = ARENASZ, arenaLimit = ARENABUDGET, bufSz;
     u_long sz;
-    long x;
-    int opt, nrecs, nFiltCalls, parseOk;
-    int noSyscall = 0;
+    int opt;
     int enableTimer = 0;
+    int stdFilePool = 0;
+    int nFilePool = 0;
+    int nChildPool = 0;
+    int suspendChildren = 0;
+    int batchTimeout = 1000;
 
-    nFiltCalls = 0;
     prog = argv[0];
-    while((opt = getopt(argc, argv, "f:tTvx")) != -1) {
+    while((opt = getopt(argc, argv, "aA:B:b:c:f:i:L:N:o:p:PstTvw:x")) != -1) {
         switch(opt) {
-        case 'f': 
-            if(nFiltCalls >= MAXFILTCALLS) {
-                printf("too many -f args!\n");
+        case 'a':
+            aflNative = 1;
+            break;
+        case 'A':
+            if(parseSize(optarg, &arenaSz) == -1) {
+                printf("bad arg to -A: %s\n", optarg);
                 exit(1);
             }
-            if(parseU16(optarg, &filtCalls[nFiltCalls]) == -1) {
+            break;
+        case 'B':
+            if(parseSize(optarg, &bufSz) == -1 || bufSz < 1 || bufSz > MAXBUFSZ) {
+                printf("bad arg to -B: %s\n", optarg);
+                exit(1);
+            }
+            aflBufSize = bufSz;
+            break;
+        case 'b':
+            batchSrc = optarg;
+            break;
+        case 'c':
+            nChildPool = atoi(optarg);
+            break;
+        case 'f': 
+            if(filterAdd(optarg) == -1) {
                 printf("bad arg to -f: %s\n", optarg);
                 exit(1);
             }
-            nFiltCalls++;
+            break;
+        case 'i':
+            aflInputFile = optarg;
+            break;
+        case 'L':
+            if(parseSize(optarg, &arenaLimit) == -1) {
+                printf("bad arg to -L: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'N':
+            tmpPrefix = optarg;
+            break;
+        case 'o':
+            batchOut = optarg;
+            break;
+        case 'p':
+            nFilePool = atoi(optarg);
+            break;
+        case 'P':
+            stdFilePool = 1;
+            break;
+        case 's':
+            suspendChildren = 1;
             break;
         case 't':
             aflTestMode = 1;
@@ -113,6 +205,9 @@ main(int argc, char **argv)
         case 'v':
             verbose++;
             break;
+        case 'w':
+            batchTimeout = atoi(optarg);
+            break;
         case 'x':
             noSyscall = 1;
             break;
@@ -126,39 +221,40 @@ main(int argc, char **argv)
     argv += optind;
     if(argc)
         usage(prog);
+    if(batchSrc)
+        aflTestMode = 1;
+#ifdef __linux__
+    /* inputs chmod and unlink things like "/", dont let them near the fuzzer box */
+    if(!noSyscall && geteuid() == 0) {
+        printf("refusing to perform system calls as root, use -x or run as another user\n");
+        exit(1);
+    }
+#endif
 
-    if(!aflTestMode)
+    /* the native fork server does the watcher's job itself */
+    if(!aflTestMode && !aflNative)
         watcher();
+    /* argument memory is mapped before the fork so children share it */
+    arenaInit(arenaSz, arenaLimit);
+    if(stdFilePool)
+        initStdFilePool();
+    /* nothing resets the filesystem between batch or native test cases */
+    initFilePool(nFilePool, tmpPrefix, batchSrc || aflNative);
+    if(nChildPool)
+        initChildPool(nChildPool, suspendChildren);
+    if(batchSrc)
+        return runBatch(batchSrc, batchOut, batchTimeout, runInput);
+
     startForkserver(enableTimer);
     buf = getWork(&sz);
     //printf("got work: %d - %.*s\n", sz, (int)sz, buf);
 
-    /* trace our driver code while parsing workbuf */
-    extern void __init(), __fini();
-    startWork((u_long)__init, (u_long)__fini);
-    mkSlice(&slice, buf, sz);
-    parseOk = parseSysRecArr(&slice, 3, recs, &nrecs);
-    if(verbose) {
-        printf("read %ld bytes, parse result %d nrecs %d\n", sz, parseOk, (int)nrecs);
-        if(parseOk == 0)
-            showSysRecArr(recs, nrecs);
-    }
-
-    if(parseOk == 0 && filterCalls(filtCalls, nFiltCalls, recs, nrecs)) {
-        /* trace kernel code while performing syscalls */
-        startWork(0xffffffff81001000L, 0xffffffffffffffffL);
-        if(noSyscall) {
-            x = 0;
-        } else {
-            /* note: if this crashes, watcher will do doneWork for us */
-            x = doSysRecArr(recs, nrecs);
-        }
-        if (verbose) printf("syscall returned %ld\n", x);
-    } else {
-        if (verbose) printf("Rejected by filter\n");
-    }
+    memset(&res, 0, sizeof res);
+    res.truncated = aflTruncated;
+    if(verbose && res.truncated)
+        printf("input truncated to %ld bytes\n", sz);
+    runInput(buf, sz, &res);
     fflush(stdout);
-    doneWork(0);
+    doneWork((res.truncated ? DONE_TRUNC : 0) | res.reject);
     return 0;
 }
-
@@ -1,6 +1,8 @@
 
 #include <stdlib.h>
 
+#include "done.h"
+
 struct slice {
     unsigned char *cur;
     unsigned char *end;
@@ -8,11 +10,25 @@ struct slice {
 
 /* aflCall.c */
 extern int aflTestMode;
+extern int aflNative;
+extern char *aflInputFile;
+extern u_long aflBufSize;
+#define MAXBUFSZ (16 * 1024 * 1024)
+extern int aflTruncated;
 int startForkserver(int ticks);
 char *getWork(u_long *sizep);
+char *workBuf(u_long *sizep);
 int startWork(u_int64_t start, u_int64_t end);
 int doneWork(int val);
 
+/* arena.c */
+#define ARENASZ (256 * 1024)
+#define ARENABUDGET (16 * 1024 * 1024)
+int arenaInit(size_t sz, size_t limit);
+void *arenaAlloc(size_t sz);
+char *arenaStrdup(const char *s);
+void arenaReset(void);
+
 /* parse.c */
 void mkSlice(struct slice *b, void *base, size_t sz);
 unsigned char *sliceBuf(struct slice *b);
@@ -22,5 +38,8 @@ int getU8(struct slice *b, u_int8_t *x);
 int getU16(struct slice *b, u_int16_t *x);
 int getU32(struct slice *b, u_int32_t *x);
 int getU64(struct slice *b, u_int64_t *x);
+int getSlice(struct slice *b, size_t sz, struct slice *x);
+int getLenSlices(struct slice *b, size_t max, struct slice *x, size_t *nx);
+int indexDelims(struct slice *b, char *delim0, char *delim1, int delsz);
 int getDelimSlices(struct slice *b, char *delim, int delsz, size_t max, struct slice *x, size_t *nx);
 
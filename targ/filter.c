@@ -0,0 +1,133 @@
+/*
+ * System call filter.
+ *
+ * Allowed and denied call numbers are kept as 65536-bit maps so
+ * checking a call is a couple of bit tests.  The parser checks the
+ * number in each call header before any argument is made, so filtered
+ * inputs never create files, children or allocations.
+ *
+ * A spec is a comma separated list of numbers or ranges (lo-hi).
+ * Items starting with ^ are denied, and @file reads more items from
+ * a file (separated by commas or whitespace, # comments to the end of
+ * the line, which may use @file again).  If anything is allowed, calls not allowed are filtered;
+ * denied calls are always filtered.  For example "^1,^2,^111" runs
+ * everything except exit, fork and sigsuspend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "drv.h"
+#include "sysc.h"
+
+#define NCALLNR 65536
+/* @file can nest this deep, so a file including itself fails */
+#define MAXINCLUDE 8
+
+static unsigned char allowMap[NCALLNR / 8];
+static unsigned char denyMap[NCALLNR / 8];
+static int nAllow = 0;
+int filterOn = 0;
+
+#define isset(m, n) ((m)[(n) >> 3] & (1 << ((n) & 7)))
+#define setbit(m, n) ((m)[(n) >> 3] |= (1 << ((n) & 7)))
+
+static int
+parseNr(char *p, char **endp, unsigned long *x)
+{
+    *x = strtoul(p, endp, 0);
+    if(*endp == p || *x >= NCALLNR)
+        return -1;
+    return 0;
+}
+
+static int filterFile(char *fn);
+
+/* add one item: nr, lo-hi, ^item or @file */
+static int
+filterItem(char *p)
+{
+    unsigned long lo, hi, nr;
+    unsigned char *map;
+    char *endp;
+
+    if(*p == '@')
+        return filterFile(p + 1);
+    map = allowMap;
+    if(*p == '^') {
+        map = denyMap;
+        p++;
+    }
+    if(parseNr(p, &endp, &lo) == -1)
+        return -1;
+    hi = lo;
+    if(*endp == '-' && parseNr(endp + 1, &endp, &hi) == -1)
+        return -1;
+    if(*endp != 0 || hi < lo)
+        return -1;
+    for(nr = lo; nr <= hi; nr++)
+        setbit(map, nr);
+    if(map == allowMap)
+        nAllow++;
+    filterOn = 1;
+    return 0;
+}
+
+static int
+filterFile(char *fn)
+{
+    static int depth = 0;
+    char line[1024], *p, *tok, *last;
+    FILE *fp;
+    int ret = 0;
+
+    if(depth >= MAXINCLUDE) {
+        fprintf(stderr, "%s: filter files nested too deep\n", fn);
+        return -1;
+    }
+    fp = fopen(fn, "r");
+    if(!fp) {
+        perror(fn);
+        return -1;
+    }
+    depth++;
+    while(ret == 0 && fgets(line, sizeof line, fp)) {
+        p = strchr(line, '#');
+        if(p)
+            *p = 0;
+        for(tok = strtok_r(line, ", \t\r\n", &last); tok && ret == 0; tok = strtok_r(NULL, ", \t\r\n", &last))
+            ret = filterItem(tok);
+    }
+    depth--;
+    fclose(fp);
+    return ret;
+}
+
+/* add a filter spec, returning -1 if it is malformed */
+int
+filterAdd(char *spec)
+{
+    char *buf, *p, *item;
+    int ret = 0;
+
+    buf = strdup(spec);
+    if(!buf)
+        return -1;
+    for(p = buf; ret == 0 && (item = strsep(&p, ",")) != NULL; ) {
+        if(*item)
+            ret = filterItem(item);
+    }
+    free(buf);
+    return ret;
+}
+
+/* true if the filter lets call nr run */
+int
+filterCall(u_int16_t nr)
+{
+    if(nAllow && !isset(allowMap, nr))
+        return 0;
+    return !isset(denyMap, nr);
+}
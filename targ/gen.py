@@ -2,14 +2,19 @@
 """
 Generate syscall input files in the driver's file format.
 """
-import struct, sys, subprocess
+import os, struct, sys, subprocess
 
 BUFDELIM = "\xa5\xc9\x92"
 CALLDELIM = "\xb7\xe3\xfe"
+V2MAGIC = "\xc2"
+
+# input format written by mkSyscalls, 1 (delimited) or 2 (length-prefixed)
+FORMAT = int(os.environ.get('GENFMT', '1'))
 
 class Buf(object) :
     def __init__(self) :
         self.buf = []
+        self.bufs = []
         self.pos = 0
     def add(self, x) :
         #print repr(self), 'add', x.encode('hex')
@@ -40,8 +45,7 @@ class String(object) :
         self.pos = xtra.pos
         xtra.pos += 1
         buf.pack('!B', typ)
-        xtra.add(BUFDELIM)
-        xtra.add(self.v)
+        xtra.bufs.append(self.v)
     def mkArg(self, buf, xtra) :
         self.mkArgTyp(2, buf, xtra)
 def StringZ(v) :
@@ -99,7 +103,8 @@ def mkArg(buf, xtra, x) :
         x = Num(x)
     x.mkArg(buf, xtra)
 
-def mkSyscall(nr, *args) :
+def mkCall(nr, *args) :
+    """Return the header and buffers for a call."""
     args = list(args)
     while len(args) < 7 :
         args.append(0)
@@ -110,14 +115,54 @@ def mkSyscall(nr, *args) :
     for n,arg in enumerate(args) :
         #print 'arg', n
         mkArg(buf, xtra, arg)
-    return str(buf) + str(xtra)
+    return str(buf), xtra.bufs
+
+def section(x) :
+    return struct.pack('!I', len(x)) + x
+
+def mkSyscall(nr, *args) :
+    hdr, bufs = mkCall(nr, *args)
+    return hdr + ''.join(BUFDELIM + b for b in bufs)
+
+def mkSyscall2(nr, *args) :
+    hdr, bufs = mkCall(nr, *args)
+    return ''.join(section(x) for x in [hdr] + bufs)
 
 def mkSyscalls(*calls) :
+    if FORMAT == 2 :
+        return mkSyscalls2(*calls)
     r = []
     for call in calls :
         r.append(mkSyscall(*call))
     return CALLDELIM.join(r)
 
+def mkSyscalls2(*calls) :
+    return V2MAGIC + ''.join(section(mkSyscall2(*call)) for call in calls)
+
+def splitDelim(buf, delim) :
+    """Split like the driver does: no empty slice after a trailing delim."""
+    r = []
+    pos = 0
+    while pos != len(buf) :
+        n = buf.find(delim, pos)
+        if n == -1 :
+            r.append(buf[pos:])
+            break
+        r.append(buf[pos:n])
+        pos = n + len(delim)
+    return r
+
+def toV2(buf) :
+    """Convert a v1 input to the v2 format."""
+    if buf[:1] == V2MAGIC :
+        return buf
+    recs = splitDelim(buf, CALLDELIM)
+    return V2MAGIC + ''.join(section(''.join(section(x) for x in splitDelim(rec, BUFDELIM))) for rec in recs)
+
+def readFn(fn) :
+    with file(fn, 'r') as f :
+        return f.read()
+
 def writeFn(fn, buf) :
     with file(fn, 'w') as f :
         f.write(buf)
@@ -129,6 +174,26 @@ def test(fn) :
     st = subprocess.call("./driver -tv < %s > /tmp/.xxx" % fn, shell=True)
     st = subprocess.call("egrep -q 'returned [^-]' /tmp/.xxx", shell=True)
     return st == 0
+
+def testBatch(fns) :
+    """Like test() but runs all the files in one driver process.
+    The driver removes /tmp/file? before each one, like test() does."""
+    stream = Buf()
+    for fn in fns :
+        buf = file(fn, 'r').read()
+        stream.pack('!I', len(buf))
+        stream.add(buf)
+    # fd=1 is not readable here either
+    null = file('/dev/null', 'w')
+    p = subprocess.Popen("./driver -b - -o /tmp/.xxx", shell=True, stdin=subprocess.PIPE, stdout=null)
+    p.communicate(str(stream))
+    passed = [False] * len(fns)
+    for l in file('/tmp/.xxx', 'r') :
+        fs = l.rstrip('\n').split('\t')
+        res = dict(f.split('=', 1) for f in fs[1:])
+        ret = res['ret'].split(',')[-1]
+        passed[int(fs[0][1:])] = ret != '-' and not ret.startswith('-')
+    return passed
     
 if __name__ == '__main__' :
     read = 3
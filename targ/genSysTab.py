@@ -0,0 +1,60 @@
+#!/usr/bin/env python2.7
+"""
+Generate the OpenBSD to Linux system call number table from templ.txt.
+Calls listed in comments (such as the ones made by gen2.py) are included.
+"""
+import re, sys
+
+# OpenBSD names that are spelled differently on Linux
+ALIAS = {
+    '__getcwd' : 'getcwd',
+    '__semctl' : 'semctl',
+    'fsatat' : 'newfstatat',
+    'getdents' : 'getdents64',
+    'getthrid' : 'gettid',
+    'msgrecv' : 'msgrcv',
+    'msgsend' : 'msgsnd',
+    'pselect' : 'pselect6',
+    'sigaction' : 'rt_sigaction',
+    'sigpending' : 'rt_sigpending',
+    'sigprocmask' : 'rt_sigprocmask',
+    'sigreturn' : 'rt_sigreturn',
+    'sigsuspend' : 'rt_sigsuspend',
+    'thrkill' : 'tkill',
+}
+
+# never run these on the fuzzer box
+NOMAP = set([
+    'acct', 'adjfreq', 'adjtime', 'clock_settime', 'execve', 'kill',
+    'mount', 'nfssvc', 'o58_kill', 'ptrace', 'quotactl', 'reboot',
+    'settimeofday', 'swapctl', 'sysctl', 'thrkill', 'umount', 'vfork',
+])
+
+pat = re.compile(r'^#?\s*(?:OK\s+|SKIP\s+)?(\d+)\s+(\w+)')
+
+def main() :
+    calls = {}
+    for l in sys.stdin :
+        m = pat.match(l)
+        if m :
+            calls.setdefault(int(m.group(1)), m.group(2))
+
+    w = sys.stdout.write
+    w("// autogenerated by genSysTab.py. DO NOT EDIT !!!!!!\n")
+    w("#include <sys/syscall.h>\n\n")
+    w('#include "drv.h"\n')
+    w('#include "sysc.h"\n\n')
+    w("/* return the Linux number for OpenBSD system call nr, or -1 */\n")
+    w("int linuxSysNr(int nr)\n{\n")
+    w("    switch(nr) {\n")
+    for nr in sorted(calls) :
+        nm = calls[nr]
+        if nm in NOMAP :
+            continue
+        sym = 'SYS_' + ALIAS.get(nm, nm)
+        w("#ifdef %s\n    case %d: return %s;\n#endif\n" % (sym, nr, sym))
+    w("    default: return -1;\n")
+    w("    }\n}\n")
+
+if __name__ == '__main__' :
+    main()
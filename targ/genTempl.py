@@ -85,16 +85,14 @@ TEST=0
 
 def genCalls(nr, nm, args, notest) :
     #print nr, nm, args
-    passed = 0
+    fns = []
     for n,xargs in enumerate(genArgs(args)) :
 	fn = 'inputs/%03d_%s_%03d' % (nr, nm, n)
         #print fn, nr, n, nm, xargs
 	call = tuple([nr] + xargs)
     	writeFn(fn, mkSyscalls(call))
-        if TEST and not notest :
-            if test(fn) :
-                passed += 1
-    if TEST and not notest and not passed :
+        fns.append(fn)
+    if TEST and not notest and not any(testBatch(fns)) :
         print nr, nm, "no pass"
 
 def proc(fn) :
@@ -0,0 +1,718 @@
+/*
+ * Format-aware custom mutator for AFL.
+ *
+ * Inputs are decoded into calls and typed argument tokens with the
+ * same slice code the driver uses, mutated at the level of syscall
+ * numbers, argument values, argument types, buffers and whole calls,
+ * and re-encoded in the format they came in.  Each result is checked
+ * with the driver's own parser (with side effects stubbed out) and
+ * the mutation is retried if it would not parse.
+ *
+ * Build with "make mutator.so" and load it with
+ *     AFL_CUSTOM_MUTATOR_LIBRARY=./mutator.so
+ * This uses the AFL++ custom mutator interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+
+#include "drv.h"
+#include "sysc.h"
+
+int verbose = 0;
+
+#ifdef SYS_MAXSYSCALL
+#define MAXNR SYS_MAXSYSCALL
+#else
+#define MAXNR 512
+#endif
+
+#define MAXTOK 1024         /* argument tokens per call, counting vector elements */
+#define MAXTRIES 16         /* mutations to try before giving up on an input */
+#define POOLSZ (1024 * 1024) /* scratch space for new buffer contents */
+
+#define isVec(typ) ((typ) == 7 || (typ) == 11)
+#define hasBuf(typ) ((typ) == 2 || (typ) == 4 || (typ) == 8)
+
+/*
+ * An argument in the order it appears in the call header.  Vectors
+ * hold their element count in val and are followed by their elements.
+ */
+struct mtok {
+    u_int8_t typ;
+    u_int64_t val;          /* Num value, Alloc size, StdFile/Pid type, Ref call<<8|arg */
+    unsigned char *buf;     /* Buf, File and Filename contents */
+    size_t len;
+};
+
+struct mcall {
+    u_int16_t nr;
+    int ntok;
+    struct mtok tok[MAXTOK];
+};
+
+struct minput {
+    int v2, ncalls;
+    struct mcall calls[MAXCALLS];
+};
+
+struct mstate {
+    u_int64_t rnd;
+    struct minput orig, work, other;
+    unsigned char *out, *pool;
+    size_t outsz, poolpos;
+};
+
+static u_int64_t interesting[] = {
+    0, 1, 2, 0x7f, 0x80, 0xff, 0x100, 0x400, 0x1000, 0x7fff, 0x8000,
+    0xffff, 0x10000, 0x7fffffff, 0x80000000, 0xffffffff, 0x100000000ULL,
+    0x7fffffffffffffffULL, 0x8000000000000000ULL, -1ULL, -2ULL,
+};
+#define NINTERESTING (sizeof interesting / sizeof interesting[0])
+
+static u_int64_t
+rnd(struct mstate *m)
+{
+    /* xorshift64* */
+    m->rnd ^= m->rnd >> 12;
+    m->rnd ^= m->rnd << 25;
+    m->rnd ^= m->rnd >> 27;
+    return m->rnd * 0x2545f4914f6cdd1dULL;
+}
+
+static u_int64_t
+rndBelow(struct mstate *m, u_int64_t n)
+{
+    return n ? rnd(m) % n : 0;
+}
+
+static unsigned char *
+poolAlloc(struct mstate *m, size_t sz)
+{
+    unsigned char *p;
+
+    if(sz > POOLSZ - m->poolpos)
+        return NULL;
+    p = m->pool + m->poolpos;
+    m->poolpos += sz;
+    return p;
+}
+
+/* decode the tokens of one argument, following parseArg in sysc.c */
+static int
+decodeArg(struct slice *b, struct slice *bufs, size_t nbufs, size_t *bufpos, struct mcall *c)
+{
+    struct mtok *t;
+    u_int8_t u8, u8b;
+    u_int16_t u16;
+    u_int32_t u32;
+    int i;
+
+    if(c->ntok >= MAXTOK)
+        return -1;
+    t = &c->tok[c->ntok++];
+    memset(t, 0, sizeof *t);
+    if(getU8(b, &t->typ) == -1)
+        return -1;
+    switch(t->typ) {
+    case 0:
+        return getU64(b, &t->val);
+    case 1:
+        if(getU32(b, &u32) == -1)
+            return -1;
+        t->val = u32;
+        return 0;
+    case 2: case 4: case 8:
+        if(*bufpos >= nbufs)
+            return -1;
+        t->buf = sliceBuf(&bufs[*bufpos]);
+        t->len = sliceSize(&bufs[*bufpos]);
+        (*bufpos)++;
+        return 0;
+    case 3:
+        return 0;
+    case 5:
+        if(getU16(b, &u16) == -1)
+            return -1;
+        t->val = u16;
+        return 0;
+    case 7: case 11:
+        if(getU8(b, &u8) == -1)
+            return -1;
+        t->val = u8;
+        for(i = 0; i < u8; i++) {
+            if(decodeArg(b, bufs, nbufs, bufpos, c) == -1)
+                return -1;
+        }
+        return 0;
+    case 9:
+        if(getU8(b, &u8) == -1)
+            return -1;
+        t->val = u8;
+        return 0;
+    case 10:
+        if(getU8(b, &u8) == -1
+        || getU8(b, &u8b) == -1)
+            return -1;
+        t->val = (u8 << 8) | u8b;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static int
+decodeCall(struct slice *rec, int v2, struct mcall *c)
+{
+    struct slice bufs[NSLICES];
+    size_t nbufs, bufpos;
+    int i;
+
+    if(v2) {
+        if(getLenSlices(rec, NSLICES, bufs, &nbufs) == -1)
+            return -1;
+    } else {
+        if(getDelimSlices(rec, BUFDELIM, sizeof BUFDELIM-1, NSLICES, bufs, &nbufs) == -1)
+            return -1;
+    }
+    if(nbufs < 1 || getU16(&bufs[0], &c->nr) == -1)
+        return -1;
+    c->ntok = 0;
+    bufpos = 1;
+    for(i = 0; i < 7; i++) {
+        if(decodeArg(&bufs[0], bufs, nbufs, &bufpos, c) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+static int
+decode(unsigned char *buf, size_t sz, struct minput *in)
+{
+    struct slice b, recs[MAXCALLS];
+    size_t i, nrecs;
+
+    mkSlice(&b, buf, sz);
+    in->v2 = (sz > 0 && buf[0] == V2MAGIC);
+    if(in->v2) {
+        b.cur++;
+        if(getLenSlices(&b, MAXCALLS, recs, &nrecs) == -1)
+            return -1;
+    } else {
+        indexDelims(&b, CALLDELIM, BUFDELIM, sizeof CALLDELIM-1);
+        if(getDelimSlices(&b, CALLDELIM, sizeof CALLDELIM-1, MAXCALLS, recs, &nrecs) == -1)
+            return -1;
+    }
+    for(i = 0; i < nrecs; i++) {
+        if(decodeCall(&recs[i], in->v2, &in->calls[i]) == -1)
+            return -1;
+    }
+    in->ncalls = nrecs;
+    return nrecs ? 0 : -1;
+}
+
+/* output writer that stops at the end of the buffer */
+struct out {
+    unsigned char *p, *end;
+    int err;
+};
+
+static void
+put(struct out *o, const void *x, size_t sz)
+{
+    if(o->err || sz > (size_t)(o->end - o->p)) {
+        o->err = 1;
+        return;
+    }
+    memcpy(o->p, x, sz);
+    o->p += sz;
+}
+
+static void
+putU8(struct out *o, u_int8_t x)
+{
+    put(o, &x, 1);
+}
+
+static void
+putBE(struct out *o, u_int64_t x, int sz)
+{
+    unsigned char b[8];
+    int i;
+
+    for(i = 0; i < sz; i++)
+        b[i] = x >> (8 * (sz - 1 - i));
+    put(o, b, sz);
+}
+
+/* reserve a 32-bit length to fill in with putLenEnd */
+static unsigned char *
+putLenStart(struct out *o)
+{
+    unsigned char *p = o->p;
+
+    putBE(o, 0, 4);
+    return p;
+}
+
+static void
+putLenEnd(struct out *o, unsigned char *p)
+{
+    u_int32_t sz;
+
+    if(o->err)
+        return;
+    sz = o->p - p - 4;
+    p[0] = sz >> 24; p[1] = sz >> 16; p[2] = sz >> 8; p[3] = sz;
+}
+
+static void
+encodeCall(struct out *o, struct mcall *c, int v2)
+{
+    struct mtok *t;
+    unsigned char *len = NULL;
+    int i;
+
+    if(v2)
+        len = putLenStart(o);
+    putBE(o, c->nr, 2);
+    for(i = 0; i < c->ntok; i++) {
+        t = &c->tok[i];
+        putU8(o, t->typ);
+        switch(t->typ) {
+        case 0: putBE(o, t->val, 8); break;
+        case 1: putBE(o, t->val, 4); break;
+        case 5: putBE(o, t->val, 2); break;
+        case 7: case 9: case 11: putU8(o, t->val); break;
+        case 10: putBE(o, t->val, 2); break;
+        }
+    }
+    if(v2)
+        putLenEnd(o, len);
+
+    /* buffers go in the order their args consume them */
+    for(i = 0; i < c->ntok; i++) {
+        t = &c->tok[i];
+        if(!hasBuf(t->typ))
+            continue;
+        if(v2) {
+            putBE(o, t->len, 4);
+        } else {
+            put(o, BUFDELIM, sizeof BUFDELIM-1);
+        }
+        put(o, t->buf, t->len);
+    }
+}
+
+static size_t
+encode(struct minput *in, unsigned char *buf, size_t sz)
+{
+    struct out o;
+    unsigned char *len;
+    int i;
+
+    o.p = buf;
+    o.end = buf + sz;
+    o.err = 0;
+    if(in->v2)
+        putU8(&o, V2MAGIC);
+    for(i = 0; i < in->ncalls; i++) {
+        if(in->v2) {
+            len = putLenStart(&o);
+            encodeCall(&o, &in->calls[i], 1);
+            putLenEnd(&o, len);
+        } else {
+            if(i > 0)
+                put(&o, CALLDELIM, sizeof CALLDELIM-1);
+            encodeCall(&o, &in->calls[i], 0);
+        }
+    }
+    return o.err ? 0 : o.p - buf;
+}
+
+/* does the driver accept this input? */
+static int
+parses(unsigned char *buf, size_t sz)
+{
+    struct sysRec recs[MAXCALLS];
+    struct slice b;
+    int n, ok;
+
+    arenaReset();
+    mkSlice(&b, buf, sz);
+    ok = parseSysRecArr(&b, MAXCALLS, recs, &n) == 0;
+    arenaReset();
+    return ok;
+}
+
+/* number of tokens in the argument starting at tok i */
+static int
+span(struct mcall *c, int i)
+{
+    u_int64_t j;
+    int n = 1;
+
+    if(isVec(c->tok[i].typ)) {
+        for(j = 0; j < c->tok[i].val && i + n < c->ntok; j++)
+            n += span(c, i + n);
+    }
+    return n;
+}
+
+/* replace n tokens at i with m new ones, returning where they go */
+static struct mtok *
+splice(struct mcall *c, int i, int n, int m)
+{
+    if(c->ntok - n + m > MAXTOK)
+        return NULL;
+    memmove(&c->tok[i + m], &c->tok[i + n], (c->ntok - i - n) * sizeof c->tok[0]);
+    c->ntok += m - n;
+    return &c->tok[i];
+}
+
+static u_int64_t
+mutNum(struct mstate *m, u_int64_t x)
+{
+    switch(rndBelow(m, 6)) {
+    case 0: return interesting[rndBelow(m, NINTERESTING)];
+    case 1: return x + 1 + rndBelow(m, 35);
+    case 2: return x - 1 - rndBelow(m, 35);
+    case 3: return x ^ (1ULL << rndBelow(m, 64));
+    case 4: return rndBelow(m, 64);
+    default: return rnd(m);
+    }
+}
+
+static u_int64_t
+mutSize(struct mstate *m, u_int64_t x)
+{
+    switch(rndBelow(m, 3)) {
+    case 0: return interesting[rndBelow(m, 13)];
+    case 1: return rndBelow(m, 0x2000);
+    default: return (x + rndBelow(m, 64) - 32) & 0xffff;
+    }
+}
+
+static int
+stdFileTyp(struct mstate *m)
+{
+    int i, typ = 0;
+
+    /* getStdFile knows which types exist */
+    for(i = 0; i < 64; i++) {
+        typ = rndBelow(m, 64);
+        if(getStdFile(typ) != -1)
+            break;
+    }
+    return typ;
+}
+
+/* copy a buffer into the pool, resized to len, so it can be edited */
+static unsigned char *
+ownBuf(struct mstate *m, struct mtok *t, size_t len)
+{
+    unsigned char *p;
+    size_t i;
+
+    p = poolAlloc(m, len);
+    if(!p)
+        return NULL;
+    memcpy(p, t->buf, len < t->len ? len : t->len);
+    for(i = t->len; i < len; i++)
+        p[i] = rnd(m);
+    t->buf = p;
+    t->len = len;
+    return p;
+}
+
+static int
+mutBuf(struct mstate *m, struct mtok *t)
+{
+    unsigned char *p;
+    size_t pos, n, len = t->len;
+
+    switch(rndBelow(m, 6)) {
+    case 0: /* flip a bit */
+        if(!len || !(p = ownBuf(m, t, len)))
+            return -1;
+        pos = rndBelow(m, len);
+        p[pos] ^= 1 << rndBelow(m, 8);
+        return 0;
+    case 1: /* set a byte */
+        if(!len || !(p = ownBuf(m, t, len)))
+            return -1;
+        p[rndBelow(m, len)] = rndBelow(m, 2) ? rnd(m) : interesting[rndBelow(m, 5)];
+        return 0;
+    case 2: /* insert bytes */
+        n = 1 + rndBelow(m, 16);
+        pos = rndBelow(m, len + 1);
+        if(!(p = ownBuf(m, t, len + n)))
+            return -1;
+        memmove(p + pos + n, p + pos, len - pos);
+        for(; n; n--)
+            p[pos + n - 1] = rnd(m);
+        return 0;
+    case 3: /* delete bytes */
+        if(!len || !(p = ownBuf(m, t, len)))
+            return -1;
+        pos = rndBelow(m, len);
+        n = 1 + rndBelow(m, len - pos);
+        memmove(p + pos, p + pos + n, len - pos - n);
+        t->len -= n;
+        return 0;
+    case 4: /* truncate, keeping a string terminated */
+        n = rndBelow(m, len + 1);
+        if(!(p = ownBuf(m, t, n + 1)))
+            return -1;
+        p[n] = 0;
+        return 0;
+    default: /* resize */
+        return ownBuf(m, t, rndBelow(m, 256)) ? 0 : -1;
+    }
+}
+
+/* make a random new argument at tok i, replacing n tokens */
+static int
+newArg(struct mstate *m, struct mcall *c, int ncall, int i, int n)
+{
+    static u_int8_t typs[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 10, 11 };
+    struct mtok *t;
+    int j, nsub;
+
+    switch(typs[rndBelow(m, sizeof typs)]) {
+    case 1:
+        if(!(t = splice(c, i, n, 1)))
+            return -1;
+        t->typ = 1;
+        t->val = mutSize(m, 0);
+        return 0;
+    case 2: case 4: case 8:
+        if(!(t = splice(c, i, n, 1)))
+            return -1;
+        t->typ = (u_int8_t[]){ 2, 4, 8 }[rndBelow(m, 3)];
+        t->buf = NULL;
+        t->len = 0;
+        return ownBuf(m, t, rndBelow(m, 64)) ? 0 : -1;
+    case 3:
+        if(!(t = splice(c, i, n, 1)))
+            return -1;
+        t->typ = 3;
+        return 0;
+    case 5:
+        if(!(t = splice(c, i, n, 1)))
+            return -1;
+        t->typ = 5;
+        t->val = stdFileTyp(m);
+        return 0;
+    case 7: case 11:
+        nsub = 1 + rndBelow(m, 4);
+        if(!(t = splice(c, i, n, 1 + nsub)))
+            return -1;
+        t->typ = rndBelow(m, 2) ? 7 : 11;
+        t->val = nsub;
+        for(j = 1; j <= nsub; j++) {
+            memset(&t[j], 0, sizeof t[j]);
+            t[j].val = mutNum(m, 0);
+        }
+        return 0;
+    case 9:
+        if(!(t = splice(c, i, n, 1)))
+            return -1;
+        t->typ = 9;
+        t->val = rndBelow(m, 3);
+        return 0;
+    case 10:
+        if(ncall == 0)
+            return -1;
+        if(!(t = splice(c, i, n, 1)))
+            return -1;
+        t->typ = 10;
+        t->val = (rndBelow(m, ncall) << 8) | rndBelow(m, 6);
+        return 0;
+    default:
+        if(!(t = splice(c, i, n, 1)))
+            return -1;
+        memset(t, 0, sizeof *t);
+        t->val = mutNum(m, 0);
+        return 0;
+    }
+}
+
+/* find a random token of a type wanted by pred, or -1 */
+static int
+pickTok(struct mstate *m, struct mcall *c, int (*pred)(int))
+{
+    int i, n, start;
+
+    start = rndBelow(m, c->ntok);
+    for(n = 0; n < c->ntok; n++) {
+        i = (start + n) % c->ntok;
+        if(!pred || pred(c->tok[i].typ))
+            return i;
+    }
+    return -1;
+}
+
+static int isNum(int typ) { return typ == 0; }
+static int isAlloc(int typ) { return typ == 1; }
+static int isBufTyp(int typ) { return hasBuf(typ); }
+static int isSmall(int typ) { return typ == 5 || typ == 9 || typ == 10; }
+static int isVecTyp(int typ) { return isVec(typ); }
+
+static int
+mutate(struct mstate *m, struct minput *in)
+{
+    struct mcall *c, tmp;
+    struct mtok *t;
+    int nc, i, j, n;
+
+    nc = rndBelow(m, in->ncalls);
+    c = &in->calls[nc];
+    switch(rndBelow(m, 12)) {
+    case 0: /* syscall number */
+        if(rndBelow(m, 2))
+            c->nr = rndBelow(m, MAXNR);
+        else
+            c->nr = in->calls[rndBelow(m, in->ncalls)].nr + rndBelow(m, 5) - 2;
+        return 0;
+    case 1: case 2: /* numbers */
+        if((i = pickTok(m, c, isNum)) == -1)
+            return -1;
+        c->tok[i].val = mutNum(m, c->tok[i].val);
+        return 0;
+    case 3: /* allocation sizes */
+        if((i = pickTok(m, c, isAlloc)) == -1)
+            return -1;
+        c->tok[i].val = mutSize(m, c->tok[i].val);
+        return 0;
+    case 4: case 5: /* buffer contents */
+        if((i = pickTok(m, c, isBufTyp)) == -1)
+            return -1;
+        return mutBuf(m, &c->tok[i]);
+    case 6: /* std files, pids and refs */
+        if((i = pickTok(m, c, isSmall)) == -1)
+            return -1;
+        t = &c->tok[i];
+        if(t->typ == 5)
+            t->val = stdFileTyp(m);
+        else if(t->typ == 9)
+            t->val = rndBelow(m, 3);
+        else if(nc > 0)
+            t->val = (rndBelow(m, nc) << 8) | rndBelow(m, 6);
+        return 0;
+    case 7: case 8: /* change an argument's type */
+        if((i = pickTok(m, c, NULL)) == -1)
+            return -1;
+        return newArg(m, c, nc, i, span(c, i));
+    case 9: /* add or drop a vector element */
+        if((i = pickTok(m, c, isVecTyp)) == -1)
+            return -1;
+        t = &c->tok[i];
+        if(t->val > 0 && rndBelow(m, 2)) {
+            j = i + 1;
+            for(n = rndBelow(m, t->val); n > 0 && j < c->ntok; n--)
+                j += span(c, j);
+            if(j >= c->ntok || !splice(c, j, span(c, j), 0))
+                return -1;
+            c->tok[i].val--;
+            return 0;
+        }
+        if(t->val >= 255 || newArg(m, c, nc, i + 1, 0) == -1)
+            return -1;
+        c->tok[i].val++;
+        return 0;
+    case 10: /* drop, duplicate or swap calls */
+        j = rndBelow(m, in->ncalls);
+        if(rndBelow(m, 2) && in->ncalls > 1) {
+            memmove(c, c + 1, (in->ncalls - nc - 1) * sizeof *c);
+            in->ncalls--;
+        } else if(in->ncalls < MAXCALLS && rndBelow(m, 2)) {
+            memmove(c + 1, c, (in->ncalls - nc) * sizeof *c);
+            in->ncalls++;
+        } else if(j != nc) {
+            tmp = *c;
+            *c = in->calls[j];
+            in->calls[j] = tmp;
+        }
+        return 0;
+    default: /* take a call from another input */
+        if(m->other.ncalls == 0)
+            return -1;
+        j = rndBelow(m, m->other.ncalls);
+        if(in->ncalls < MAXCALLS && rndBelow(m, 2)) {
+            nc = rndBelow(m, in->ncalls + 1);
+            memmove(&in->calls[nc + 1], &in->calls[nc], (in->ncalls - nc) * sizeof *c);
+            in->ncalls++;
+        }
+        in->calls[nc] = m->other.calls[j];
+        return 0;
+    }
+}
+
+void *
+afl_custom_init(void *afl, unsigned int seed)
+{
+    struct mstate *m;
+
+    m = calloc(1, sizeof *m);
+    if(!m)
+        return NULL;
+    m->rnd = seed * 0x9e3779b97f4a7c15ULL + 1;
+    m->pool = malloc(POOLSZ);
+    if(!m->pool) {
+        free(m);
+        return NULL;
+    }
+    arenaInit(ARENASZ, ARENABUDGET);
+    /* parse without making files or children */
+    sysStubs = 1;
+    return m;
+}
+
+size_t
+afl_custom_fuzz(void *data, unsigned char *buf, size_t buf_size, unsigned char **out_buf,
+                unsigned char *add_buf, size_t add_buf_size, size_t max_size)
+{
+    struct mstate *m = data;
+    size_t sz;
+    int try, n, i;
+
+    *out_buf = buf;
+    if(m->outsz < max_size) {
+        free(m->out);
+        m->out = malloc(max_size);
+        m->outsz = m->out ? max_size : 0;
+    }
+    if(!m->out || decode(buf, buf_size, &m->orig) == -1)
+        return buf_size;
+    if(!add_buf || decode(add_buf, add_buf_size, &m->other) == -1)
+        m->other.ncalls = 0;
+
+    for(try = 0; try < MAXTRIES; try++) {
+        m->poolpos = 0;
+        m->work = m->orig;
+        n = 1 + rndBelow(m, 4);
+        for(i = 0; i < n; i++)
+            mutate(m, &m->work);
+        sz = encode(&m->work, m->out, max_size);
+        if(sz && parses(m->out, sz)) {
+            *out_buf = m->out;
+            return sz;
+        }
+    }
+    /* couldn't make a valid mutation, hand back the input */
+    return buf_size;
+}
+
+void
+afl_custom_deinit(void *data)
+{
+    struct mstate *m = data;
+
+    free(m->out);
+    free(m->pool);
+    free(m);
+}
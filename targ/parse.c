@@ -4,6 +4,9 @@
 
 #define _GNU_SOURCE
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "drv.h"
 
 void mkSlice(struct slice *b, void *base, size_t sz)
@@ -37,45 +40,220 @@ int getU8(struct slice *b, u_int8_t *x)
     return 0;
 }
 
+/* multi-byte values are big-endian and bounds checked once */
 int getU16(struct slice *b, u_int16_t *x)
 {
-    u_int8_t h, l;
-    if(getU8(b, &h) == -1
-    || getU8(b, &l) == -1)
-        return -1;
-    *x = (h << 8) | l;
+    unsigned char *p = b->cur;
+
+    if(b->end - p < 2) return -1;
+    *x = (p[0] << 8) | p[1];
+    b->cur += 2;
     return 0;
 }
 
 int getU32(struct slice *b, u_int32_t *x)
 {
-    u_int16_t h, l;
-    if(getU16(b, &h) == -1
-    || getU16(b, &l) == -1)
-        return -1;
-    *x = (h << 16) | l;
+    unsigned char *p = b->cur;
+
+    if(b->end - p < 4) return -1;
+    *x = ((u_int32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    b->cur += 4;
     return 0;
 }
 
 int getU64(struct slice *b, u_int64_t *x)
 {
-    u_int32_t h, l;
-    if(getU32(b, &h) == -1
-    || getU32(b, &l) == -1)
+    unsigned char *p = b->cur;
+
+    if(b->end - p < 8) return -1;
+    *x = ((u_int64_t)p[0] << 56) | ((u_int64_t)p[1] << 48)
+       | ((u_int64_t)p[2] << 40) | ((u_int64_t)p[3] << 32)
+       | ((u_int64_t)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+    b->cur += 8;
+    return 0;
+}
+
+/* take the next sz bytes as a slice */
+int getSlice(struct slice *b, size_t sz, struct slice *x)
+{
+    if((size_t)(b->end - b->cur) < sz) return -1;
+    x->cur = b->cur;
+    x->end = b->cur + sz;
+    b->cur += sz;
+    return 0;
+}
+
+/* split a slice made of 32-bit length-prefixed sections into up to max slices */
+int getLenSlices(struct slice *b, size_t max, struct slice *x, size_t *nx)
+{
+    u_int32_t sz;
+    size_t i;
+
+    for(i = 0; i < max && b->cur != b->end; i++) {
+        if(getU32(b, &sz) == -1
+        || getSlice(b, sz, x + i) == -1)
+            return -1;
+    }
+
+    if(b->cur != b->end)
         return -1;
-    *x = ((u_int64_t)h << 32) | l;
+    *nx = i;
     return 0;
 }
 
 
+/*
+ * Delimiter positions found by indexDelims in a single pass over the
+ * work buffer.  getDelimSlices reads from this instead of rescanning
+ * each slice with memmem.
+ */
+#define MAXDELIMS 512
+static struct {
+    unsigned char *base, *end;
+    char *delim[2];
+    int delsz;
+    size_t n[2];
+    unsigned char *pos[2][MAXDELIMS];
+} idx;
+
+/* true if a suffix of a is a prefix of b, ie. matches could overlap */
+static int overlaps(char *a, char *b, int sz)
+{
+    int i;
+
+    for(i = 1; i < sz; i++) {
+        if(memcmp(a + i, b, sz - i) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* record a match at p unless it overlaps the previous match */
+static void addDelim(int k, unsigned char *p, unsigned char **skip)
+{
+    if(memcmp(p, idx.delim[k], idx.delsz) != 0 || p < skip[k])
+        return;
+    if(idx.n[k] >= MAXDELIMS) {
+        idx.base = NULL; /* too many, fall back to memmem */
+        return;
+    }
+    idx.pos[k][idx.n[k]++] = p;
+    skip[k] = p + idx.delsz;
+}
+
+/*
+ * Find all occurrences of two delimiters in one pass over b.
+ * Candidates are found by matching the first byte of each
+ * delimiter (16 bytes at a time when SSE2 is available) and
+ * then checked in full.  Positions are the same ones that
+ * repeated memmem calls would find, provided the delimiters
+ * cannot overlap themselves or each other.
+ */
+int indexDelims(struct slice *b, char *delim0, char *delim1, int delsz)
+{
+    unsigned char *p, *last, *skip[2];
+    unsigned char c0, c1;
+
+    idx.base = NULL;
+    if(delsz < 1
+    || overlaps(delim0, delim0, delsz) || overlaps(delim1, delim1, delsz)
+    || overlaps(delim0, delim1, delsz) || overlaps(delim1, delim0, delsz))
+        return -1;
+    idx.base = b->cur;
+    idx.end = b->end;
+    idx.delim[0] = delim0;
+    idx.delim[1] = delim1;
+    idx.delsz = delsz;
+    idx.n[0] = idx.n[1] = 0;
+    if(b->end - b->cur < delsz)
+        return 0;
+
+    c0 = delim0[0];
+    c1 = delim1[0];
+    skip[0] = skip[1] = b->cur;
+    last = b->end - delsz;
+    p = b->cur;
+#ifdef __SSE2__
+    {
+        __m128i v0 = _mm_set1_epi8((char)c0);
+        __m128i v1 = _mm_set1_epi8((char)c1);
+        unsigned char *q;
+        unsigned int m;
+
+        for(; p + 16 <= b->end; p += 16) {
+            __m128i x = _mm_loadu_si128((__m128i *)p);
+            m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, v0),
+                                               _mm_cmpeq_epi8(x, v1)));
+            while(m) {
+                q = p + __builtin_ctz(m);
+                m &= m - 1;
+                if(q > last)
+                    break;
+                if(*q == c0)
+                    addDelim(0, q, skip);
+                if(*q == c1)
+                    addDelim(1, q, skip);
+            }
+            if(!idx.base)
+                return -1;
+        }
+    }
+#endif
+    for(; p <= last; p++) {
+        if(*p == c0)
+            addDelim(0, p, skip);
+        if(*p == c1)
+            addDelim(1, p, skip);
+    }
+    if(!idx.base)
+        return -1;
+    return 0;
+}
+
+/* return which indexed delimiter covers slice b, or -1 */
+static int findIdx(struct slice *b, char *delim, int delsz)
+{
+    int k;
+
+    if(!idx.base || delsz != idx.delsz
+    || b->cur < idx.base || b->end > idx.end)
+        return -1;
+    for(k = 0; k < 2; k++) {
+        if(memcmp(delim, idx.delim[k], delsz) == 0)
+            return k;
+    }
+    return -1;
+}
+
 /* split a slice up into up to max slices */
 int getDelimSlices(struct slice *b, char *delim, int delsz, size_t max, struct slice *x, size_t *nx)
 {
-    unsigned char *ep;
-    size_t i;
+    unsigned char *ep, **pos;
+    size_t i, lo, hi, mid, n;
+    int k;
+
+    k = findIdx(b, delim, delsz);
+    pos = NULL;
+    lo = n = 0;
+    if(k != -1) {
+        /* first indexed delimiter at or after b->cur */
+        pos = idx.pos[k];
+        n = idx.n[k];
+        hi = n;
+        while(lo < hi) {
+            mid = (lo + hi) / 2;
+            if(pos[mid] < b->cur)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    }
 
     for(i = 0; i < max && b->cur != b->end; i++) {
-        ep = memmem(b->cur, b->end - b->cur, delim, delsz);
+        if(pos)
+            ep = (lo < n && pos[lo] + delsz <= b->end) ? pos[lo++] : NULL;
+        else
+            ep = memmem(b->cur, b->end - b->cur, delim, delsz);
         x[i].cur = b->cur;
         if(ep) {
             b->cur = ep + delsz;
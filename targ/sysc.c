@@ -1,23 +1,32 @@
+#include <dirent.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "drv.h"
 #include "sysc.h"
 
 typedef unsigned long long u64;
+#ifdef __OpenBSD__
 u64 __syscall(u64 nr, u64 a0, u64 a1, u64 a2, u64 a3, u64 a4, u64 a5, u64 a6);
+#endif
 
 extern int verbose;
 
+/* stub out args with side effects (files, children), for benchmarking and validating */
+int sysStubs = 0;
+
 /* internal syscall arg parsing state */
-#define NSLICES 7
 #define STKSZ 256
 struct parseState {
     struct sysRec *calls;
@@ -29,10 +38,25 @@ struct parseState {
 
 static int parseArg(struct slice *b, struct parseState *st, u_int64_t *x);
 
+/* why and where the last parseSysRecArr failed */
+int rejReason = REJ_NONE;
+long rejOff = 0;
+static unsigned char *inBase;
+
+/* note the first reason parsing failed and where, and fail */
+static int reject(int why, unsigned char *at)
+{
+    if(rejReason == REJ_NONE) {
+        rejReason = why;
+        rejOff = at - inBase;
+    }
+    return -1;
+}
+
 static int pushSize(struct parseState *st, u_int64_t sz)
 {
     if(st->stkpos >= STKSZ)
-        return -1;
+        return reject(REJ_STKOVER, st->slices[0].cur);
     size_t stkpos = st->stkpos++;
     st->sizeStk[stkpos] = sz;
     return 0;
@@ -41,7 +65,7 @@ static int pushSize(struct parseState *st, u_int64_t sz)
 static int popSize(struct parseState *st, u_int64_t *sz)
 {
     if(st->stkpos == 0)
-        return -1;
+        return reject(REJ_STKUNDER, st->slices[0].cur);
     size_t stkpos = --st->stkpos;
     *sz = st->sizeStk[stkpos];
     return 0;
@@ -62,7 +86,7 @@ static void dumpContents(unsigned char *buf, size_t sz)
 static int parseArgNum(struct slice *b, struct parseState *st, u_int64_t *x)
 {
     if(getU64(b, x) == -1)
-        return -1;
+        return reject(REJ_SHORT, b->cur);
     if(verbose) printf("argNum %llx\n", (unsigned long long)*x);
     return 0;
 }
@@ -74,12 +98,12 @@ static int parseArgAlloc(struct slice *b, struct parseState *st, u_int64_t *x)
     u_int32_t sz;
 
     if(getU32(b, &sz) == -1)
+        return reject(REJ_SHORT, b->cur);
+    p = arenaAlloc(sz); /* already zeroed */
+    if(!p)
+        return reject(REJ_ALLOC, b->cur);
+    if(pushSize(st, sz) == -1)
         return -1;
-    p = malloc(sz); /* note: we ignore memory leaks - exit/doneWork are perfect GCs */
-    if(!p
-    || pushSize(st, sz) == -1)
-        return -1;
-    memset(p, 0, sz);
     *x = (u_int64_t)(u_long)p;
     if(verbose) printf("argAlloc %llx - allocated %x bytes\n", (unsigned long long)*x, sz);
     return 0;
@@ -89,7 +113,7 @@ static int parseArgAlloc(struct slice *b, struct parseState *st, u_int64_t *x)
 static int parseArgBuf(struct slice *b, struct parseState *st, u_int64_t *x)
 {
     if(st->bufpos >= st->nslices)
-        return -1;
+        return reject(REJ_NOBUF, b->cur);
     size_t pos = st->bufpos++;
     struct slice *bslice = st->slices + pos;
     size_t sz = sliceSize(bslice);
@@ -110,28 +134,168 @@ static int parseArgBuflen(struct slice *b, struct parseState *st, u_int64_t *x)
     return 0;
 }
 
-/* make a file with buffer contents and set arg to fd open to the start of that file */
-static int parseArgFile(struct slice *b, struct parseState *st, u_int64_t *x)
+/*
+ * Temp files are named tmpPrefix followed by a number.  In pool mode
+ * the first nFilePool of them are made before the fork server starts
+ * and test cases only overwrite their contents.  If recheck is set
+ * nothing resets the filesystem between test cases (batch and native
+ * modes), so an earlier test case may have unlinked or renamed a
+ * pooled file and the path is checked on every use.
+ */
+#define MAXFILEPOOL 32
+static char *tmpPrefix = "/tmp/file";
+static int filePool[MAXFILEPOOL];
+static int nFilePool = 0;
+static int filePoolRecheck = 0;
+
+void initFilePool(int n, char *prefix, int recheck)
 {
-    static int num = 0;
     char namebuf[128];
+    int i, fd;
+
+    if(prefix)
+        tmpPrefix = prefix;
+    if(n > MAXFILEPOOL) {
+        fprintf(stderr, "file pool limited to %d files\n", MAXFILEPOOL);
+        n = MAXFILEPOOL;
+    }
+    filePoolRecheck = recheck;
+    for(i = 0; i < n; i++) {
+        snprintf(namebuf, sizeof namebuf - 1, "%s%d", tmpPrefix, i);
+        fd = open(namebuf, O_RDWR | O_CREAT | O_TRUNC, 0777);
+        if(fd == -1
+        || fchmod(fd, 0777) == -1) {
+            perror(namebuf);
+            exit(1);
+        }
+        filePool[i] = poolFd(fd);
+    }
+    nFilePool = n;
+}
+
+/* make sure the pooled fd for num is still the file at namebuf */
+static void recheckPoolFile(int num, char *namebuf)
+{
+    struct stat path, pooled;
     int fd;
 
-    if(st->bufpos >= st->nslices)
-        return -1;
-    size_t pos = st->bufpos++;
-    struct slice *bslice = st->slices + pos;
+    if(stat(namebuf, &path) == 0
+    && fstat(filePool[num], &pooled) == 0
+    && path.st_dev == pooled.st_dev && path.st_ino == pooled.st_ino) {
+        if((path.st_mode & 0777) != 0777)
+            fchmod(filePool[num], 0777);
+        return;
+    }
+    fd = open(namebuf, O_RDWR | O_CREAT, 0777);
+    if(fd == -1
+    || fchmod(fd, 0777) == -1
+    || dup2(fd, filePool[num]) == -1) {
+        perror(namebuf);
+        exit(1);
+    }
+    close(fd);
+    fcntl(filePool[num], F_SETFD, FD_CLOEXEC);
+}
 
-    snprintf(namebuf, sizeof namebuf - 1, "/tmp/file%d", num++);
-    fd = open(namebuf, O_RDWR | O_CREAT | O_TRUNC, 0777);
+/* like rm -rf */
+static void removeTree(char *path)
+{
+    struct dirent *ent;
+    struct stat st;
+    char sub[1024];
+    DIR *d;
+
+    if(lstat(path, &st) == -1)
+        return;
+    if(S_ISDIR(st.st_mode)) {
+        chmod(path, 0700);
+        d = opendir(path);
+        while(d && (ent = readdir(d)) != NULL) {
+            if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+                continue;
+            snprintf(sub, sizeof sub, "%s/%s", path, ent->d_name);
+            removeTree(sub);
+        }
+        if(d)
+            closedir(d);
+        rmdir(path);
+    } else {
+        unlink(path);
+    }
+}
+
+/*
+ * remove the temp files (and anything test cases put in their place)
+ * an earlier test case left behind, except for the pooled ones.  For
+ * batch mode, where nothing else resets the filesystem.
+ */
+void cleanTmpFiles(void)
+{
+    char namebuf[128];
+    int i;
+
+    for(i = nFilePool; i < 10; i++) {
+        snprintf(namebuf, sizeof namebuf - 1, "%s%d", tmpPrefix, i);
+        removeTree(namebuf);
+    }
+}
+
+/*
+ * fill the num'th temp file with bslice and return an fd open to
+ * the start of it, or if wantFd is false, close it and return 0.
+ */
+static int fillTmpFile(int num, char *namebuf, size_t namesz, struct slice *bslice, int wantFd)
+{
+    int fd;
+
+    snprintf(namebuf, namesz - 1, "%s%d", tmpPrefix, num);
+    if(sysStubs)
+        return wantFd ? STUBFD : 0;
+    if(num < nFilePool) {
+        if(filePoolRecheck)
+            recheckPoolFile(num, namebuf);
+        fd = filePool[num];
+        if(pwrite(fd, sliceBuf(bslice), sliceSize(bslice), 0) == -1
+        || ftruncate(fd, sliceSize(bslice)) == -1) {
+            perror(namebuf);
+            exit(1);
+        }
+        if(!wantFd)
+            return 0;
+        fd = dup(fd);
+        if(fd == -1
+        || lseek(fd, 0, SEEK_SET) == -1) {
+            perror(namebuf);
+            exit(1);
+        }
+        return fd;
+    }
+
+    fd = open(namebuf, (wantFd ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, 0777);
     if(fd == -1
     || write(fd, sliceBuf(bslice), sliceSize(bslice)) == -1
-    || lseek(fd, 0, SEEK_SET) == -1) {
+    || (wantFd ? lseek(fd, 0, SEEK_SET) : close(fd)) == -1) {
         perror(namebuf);
         exit(1);
     }
+    if(!wantFd)
+        return 0;
     fchmod(fd, 0777); // just in case it previously existed with other mode
-    *x = fd;
+    return fd;
+}
+
+/* make a file with buffer contents and set arg to fd open to the start of that file */
+static int parseArgFile(struct slice *b, struct parseState *st, u_int64_t *x)
+{
+    static int num = 0;
+    char namebuf[128];
+
+    if(st->bufpos >= st->nslices)
+        return reject(REJ_NOBUF, b->cur);
+    size_t pos = st->bufpos++;
+    struct slice *bslice = st->slices + pos;
+
+    *x = fillTmpFile(num++, namebuf, sizeof namebuf, bslice, 1);
     if(verbose) printf("argFile %llx - %ld bytes from %s\n", (unsigned long long)*x, (u_long)sliceSize(bslice), namebuf);
     dumpContents(sliceBuf(bslice), sliceSize(bslice));
     return 0;
@@ -143,10 +307,10 @@ static int parseArgStdFile(struct slice *b, struct parseState *st, u_int64_t *x)
     unsigned short typ;
 
     if(getU16(b, &typ) == -1)
-        return -1;
+        return reject(REJ_SHORT, b->cur);
     fd = getStdFile(typ);
     if(fd == -1)
-        return -1;
+        return reject(REJ_STDFILE, b->cur);
     *x = fd;
     if(verbose) printf("argStdFile %llx - type %d\n", (unsigned long long)*x, typ);
     return 0;
@@ -159,10 +323,10 @@ static int parseArgVec64(struct slice *b, struct parseState *st, u_int64_t *x)
     u_int8_t sz;
 
     if(getU8(b, &sz) == -1)
-        return -1;
-    vec = malloc(sz * sizeof vec[0]); /* note: we ignore memory leaks - exit/doneWork are perfect GCs */
+        return reject(REJ_SHORT, b->cur);
+    vec = arenaAlloc(sz * sizeof vec[0]);
     if(sz && !vec)
-        return -1;
+        return reject(REJ_ALLOC, b->cur);
     if(verbose) printf("argVec64 %llx - size %d\n", (unsigned long long)(u_long)vec, sz);
     for(i = 0; i < sz; i++) {
         if(verbose) printf("vec %d: ", i);
@@ -180,22 +344,16 @@ static int parseArgFilename(struct slice *b, struct parseState *st, u_int64_t *x
 {
     static int num = 0;
     char namebuf[128];
-    int fd;
 
     if(st->bufpos >= st->nslices)
-        return -1;
+        return reject(REJ_NOBUF, b->cur);
     size_t pos = st->bufpos++;
     struct slice *bslice = st->slices + pos;
 
-    snprintf(namebuf, sizeof namebuf - 1, "/tmp/file%d", num++);
-    fd = open(namebuf, O_WRONLY | O_CREAT | O_TRUNC, 0777);
-    if(fd == -1
-    || write(fd, sliceBuf(bslice), sliceSize(bslice)) == -1
-    || close(fd) == -1) {
-        perror(namebuf);
-        exit(1);
-    }
-    *x = (u_int64_t)(u_long)strdup(namebuf); /* note: we ignore memory leaks - exit/doneWork are perfect GCs */
+    fillTmpFile(num++, namebuf, sizeof namebuf, bslice, 0);
+    *x = (u_int64_t)(u_long)arenaStrdup(namebuf);
+    if(!*x)
+        return reject(REJ_ALLOC, b->cur);
     if(verbose) printf("argFilename %llx - %ld bytes from %s\n", (unsigned long long)*x, (u_long)sliceSize(bslice), namebuf);
     dumpContents(sliceBuf(bslice), sliceSize(bslice));
     return 0;
@@ -224,13 +382,126 @@ mkChild(u_int64_t *retPid)
     exit(0);
 }
 
+/*
+ * In pool mode children are forked before the fork server starts
+ * and parked until the driver exits, and child pid args are handed
+ * out from the pool before falling back to mkChild.  Suspended
+ * children catch every signal and wait in sigsuspend so that signals
+ * sent to them are always delivered the same way.
+ */
+#define MAXCHILDPOOL 16
+static pid_t childPool[MAXCHILDPOOL];
+static int nChildPool = 0, nextChild = 0;
+static int suspendPool;
+static pid_t poolOwner;
+
+static void
+ignoreSig(int sig)
+{
+}
+
+static void
+parkChild(int suspend)
+{
+    struct sigaction sa;
+    sigset_t all, none;
+    pid_t ppid;
+    int sig;
+
+    ppid = getppid();
+    if(!suspend) {
+        while(getppid() == ppid)
+            sleep(1);
+        _exit(0);
+    }
+
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = ignoreSig;
+    sigfillset(&sa.sa_mask);
+    for(sig = 1; sig < NSIG; sig++) {
+        if(sig != SIGKILL && sig != SIGSTOP)
+            sigaction(sig, &sa, NULL);
+    }
+    sigfillset(&all);
+    sigemptyset(&none);
+    sigprocmask(SIG_BLOCK, &all, NULL);
+    while(getppid() == ppid)
+        sigsuspend(&none);
+    _exit(0);
+}
+
+static void
+killChildPool(void)
+{
+    int i;
+
+    if(getpid() != poolOwner)
+        return;
+    for(i = 0; i < nChildPool; i++)
+        kill(childPool[i], SIGKILL);
+}
+
+static pid_t
+forkPoolChild(void)
+{
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if(pid == 0)
+        parkChild(suspendPool);
+    return pid;
+}
+
+void initChildPool(int n, int suspend)
+{
+    int i;
+
+    if(n > MAXCHILDPOOL)
+        n = MAXCHILDPOOL;
+    poolOwner = getpid();
+    suspendPool = suspend;
+    for(i = 0; i < n; i++)
+        childPool[i] = forkPoolChild();
+    nChildPool = n;
+    atexit(killChildPool);
+}
+
+/*
+ * Without a VM fork between test cases (batch and native modes) a
+ * test case can kill or stop pooled children for good.  The pool's
+ * owner calls this before forking each test case to replace them.
+ */
+void refillChildPool(void)
+{
+    pid_t pid;
+    int i, status;
+
+    if(getpid() != poolOwner)
+        return;
+    for(i = 0; i < nChildPool; i++) {
+        pid = waitpid(childPool[i], &status, WNOHANG | WUNTRACED);
+        if(pid == 0)
+            continue;
+        if(pid > 0 && WIFSTOPPED(status)) {
+            kill(childPool[i], SIGKILL);
+            waitpid(childPool[i], &status, 0);
+        }
+        childPool[i] = forkPoolChild();
+    }
+}
+
 /* use a pid related to our process as an arg */
 static int parseArgPid(struct slice *b, struct parseState *st, u_int64_t *x)
 {
     unsigned char typ;
 
     if(getU8(b, &typ) == -1)
-        return -1;
+        return reject(REJ_SHORT, b->cur);
     switch(typ) {
     case 0: // my pid
         *x = getpid(); 
@@ -239,11 +510,15 @@ static int parseArgPid(struct slice *b, struct parseState *st, u_int64_t *x)
         *x = getppid(); 
         break;
     case 2: // child pid
-        if(mkChild(x) == -1)
-            return -1;
+        if(sysStubs)
+            *x = STUBPID;
+        else if(nextChild < nChildPool)
+            *x = childPool[nextChild++];
+        else if(mkChild(x) == -1)
+            return reject(REJ_PID, b->cur);
         break;
     default:
-        return -1;
+        return reject(REJ_PID, b->cur - 1);
     }
     if(verbose) printf("argPid %llx - %d\n", (unsigned long long)*x, typ);
     return 0;
@@ -255,10 +530,11 @@ static int parseArgRef(struct slice *b, struct parseState *st, u_int64_t *x)
     unsigned char ncall, narg;
 
     if(getU8(b, &ncall) == -1
-    || getU8(b, &narg) == -1
-    || ncall >= st->ncalls
+    || getU8(b, &narg) == -1)
+        return reject(REJ_SHORT, b->cur);
+    if(ncall >= st->ncalls
     || narg >= 6)
-        return -1;
+        return reject(REJ_REF, b->cur - 2);
     *x = st->calls[ncall].args[narg];
     if(verbose) printf("argRef %llx - %d %d\n", (unsigned long long)*x, ncall, narg);
     return 0;
@@ -272,10 +548,10 @@ static int parseArgVec32(struct slice *b, struct parseState *st, u_int64_t *x)
     u_int8_t sz;
 
     if(getU8(b, &sz) == -1)
-        return -1;
-    vec = malloc(sz * sizeof vec[0]); /* note: we ignore memory leaks - exit/doneWork are perfect GCs */
+        return reject(REJ_SHORT, b->cur);
+    vec = arenaAlloc(sz * sizeof vec[0]);
     if(sz && !vec)
-        return -1;
+        return reject(REJ_ALLOC, b->cur);
     if(verbose) printf("argVec32 %llx - size %d\n", (unsigned long long)(u_long)vec, sz);
     for(i = 0; i < sz; i++) {
         if(verbose) printf("vec %d: ", i);
@@ -289,12 +565,8 @@ static int parseArgVec32(struct slice *b, struct parseState *st, u_int64_t *x)
     return 0;
 }
 
-static int parseArg(struct slice *b, struct parseState *st, u_int64_t *x)
+static int parseArgTyp(unsigned char typ, struct slice *b, struct parseState *st, u_int64_t *x)
 {
-    unsigned char typ;
-
-    if(getU8(b, &typ) == -1)
-        return -1;
     switch(typ) {
     case 0: return parseArgNum(b, st, x);
     case 1: return parseArgAlloc(b, st, x);
@@ -307,48 +579,180 @@ static int parseArg(struct slice *b, struct parseState *st, u_int64_t *x)
     case 9: return parseArgPid(b, st, x);
     case 10: return parseArgRef(b, st, x);
     case 11: return parseArgVec32(b, st, x);
-    default: return -1;
+    default: return reject(REJ_ARGTYPE, b->cur - 1);
     }
 }
 
-int parseSysRec(struct sysRec *calls, int ncalls, struct slice *b, struct sysRec *x)
+#ifdef PARSE_STATS
+/*
+ * Time and input bytes spent parsing each arg type.  Each arg is
+ * followed by an empty region timed the same way, and the median of
+ * those is the cost of the clock reads (see argStatClock).  Args
+ * nested in vectors are taken out of the enclosing arg's numbers.
+ */
+struct argStat argStats[NARGTYPES];
+int argStatsOn = 0;
+static unsigned long long innerNs, innerBytes;
+
+static unsigned long long statClock(void)
 {
-    struct parseState st;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int timeArg(unsigned char typ, struct slice *b, struct parseState *st, u_int64_t *x)
+{
+    unsigned long long saveNs = innerNs, saveBytes = innerBytes;
+    unsigned long long start, stop, clk, bytes;
+    unsigned char *p = b->cur;
+    size_t pos = st->bufpos;
+    int ret;
+
+    innerNs = innerBytes = 0;
+    start = statClock();
+    ret = parseArgTyp(typ, b, st, x);
+    stop = statClock();
+    clk = statClock() - stop;
+
+    /* the type byte, the rest of the arg, and any buffers it used */
+    bytes = 1 + (b->cur - p);
+    for(; pos < st->bufpos && pos < st->nslices; pos++)
+        bytes += sliceSize(&st->slices[pos]);
+    argStats[typ].n++;
+    argStats[typ].ns += stop - start - innerNs;
+    argStats[typ].clockHist[clk < CLOCKHIST ? clk : CLOCKHIST - 1]++;
+    argStats[typ].bytes += bytes - innerBytes;
+    /* the enclosing arg also sees all three of our clock reads */
+    innerNs = saveNs + stop - start + 2 * clk;
+    innerBytes = saveBytes + bytes;
+    return ret;
+}
+
+/* the median time of the empty regions timed after args of type typ */
+double argStatClock(int typ)
+{
+    unsigned long long n = 0;
     int i;
 
-    /* chop input into several slices */
-    if(getDelimSlices(b, BUFDELIM, sizeof BUFDELIM-1, NSLICES, st.slices, &st.nslices) == -1
-    || st.nslices < 1)
-        return -1;
+    for(i = 0; i < CLOCKHIST - 1; i++) {
+        n += argStats[typ].clockHist[i];
+        if(n * 2 >= argStats[typ].n)
+            break;
+    }
+    return i;
+}
+#endif
+
+static int parseArg(struct slice *b, struct parseState *st, u_int64_t *x)
+{
+    unsigned char typ;
 
-    b = &st.slices[0];
-    st.bufpos = 1;
-    st.stkpos = 0;
-    st.calls = calls;
-    st.ncalls = ncalls;
+    if(getU8(b, &typ) == -1)
+        return reject(REJ_SHORT, b->cur);
+#ifdef PARSE_STATS
+    if(argStatsOn && typ < NARGTYPES)
+        return timeArg(typ, b, st, x);
+#endif
+    return parseArgTyp(typ, b, st, x);
+}
+
+/* parse a call record already split into its header and buffer slices */
+static int parseSysRecSlices(struct sysRec *calls, int ncalls, struct parseState *st, struct sysRec *x)
+{
+    struct slice *b;
+    int i;
+
+    b = &st->slices[0];
+    st->bufpos = 1;
+    st->stkpos = 0;
+    st->calls = calls;
+    st->ncalls = ncalls;
     if(getU16(b, &x->nr) == -1)
-        return -1;
+        return reject(REJ_SHORT, b->cur);
     if(verbose) printf("call %d\n", x->nr);
     for(i = 0; i < 7; i++) {
         if(verbose) printf("arg %d: ", i);
-        if(parseArg(b, &st, &x->args[i]) == -1)
+        if(parseArg(b, st, &x->args[i]) == -1)
             return -1;
     }
     return 0;
 }
 
+/* v1 call record: header and buffers separated by BUFDELIM */
+int parseSysRec(struct sysRec *calls, int ncalls, struct slice *b, struct sysRec *x)
+{
+    struct parseState st;
+
+    if(getDelimSlices(b, BUFDELIM, sizeof BUFDELIM-1, NSLICES, st.slices, &st.nslices) == -1
+    || st.nslices < 1)
+        return reject(REJ_BUFS, b->cur);
+    return parseSysRecSlices(calls, ncalls, &st, x);
+}
+
+/* v2 call record: header and buffers each prefixed by a 32-bit length */
+int parseSysRec2(struct sysRec *calls, int ncalls, struct slice *b, struct sysRec *x)
+{
+    struct parseState st;
+
+    if(getLenSlices(b, NSLICES, st.slices, &st.nslices) == -1
+    || st.nslices < 1)
+        return reject(REJ_BUFS, b->cur);
+    return parseSysRecSlices(calls, ncalls, &st, x);
+}
+
+/* filter on the call number in a record's header, before parsing any args */
+static int
+filterRec(struct slice *rec, int v2)
+{
+    struct slice b = *rec;
+    u_int32_t hdrsz;
+    u_int16_t nr;
+
+    /* malformed headers are left for the parser to reject */
+    if(v2 && (getU32(&b, &hdrsz) == -1 || hdrsz < 2))
+        return 1;
+    if(getU16(&b, &nr) == -1)
+        return 1;
+    return filterCall(nr);
+}
+
+/*
+ * Inputs starting with V2MAGIC are in the length-prefixed v2 format,
+ * anything else is a v1 delimited input.
+ */
 int parseSysRecArr(struct slice *b, int maxRecs, struct sysRec *x, int *nRecs)
 {
-    struct slice slices[10];
+    struct slice slices[MAXRECS];
     size_t i, nslices;
+    int v2;
+
+    if(maxRecs > MAXRECS)
+        maxRecs = MAXRECS;
+    rejReason = REJ_NONE;
+    rejOff = 0;
+    inBase = b->cur;
+    v2 = (b->cur != b->end && *b->cur == V2MAGIC);
+    if(v2) {
+        b->cur++;
+        if(getLenSlices(b, maxRecs, slices, &nslices) == -1)
+            return reject(REJ_CALLS, b->cur);
+    } else {
+        /* find both delimiters in one pass, for use by all getDelimSlices below */
+        indexDelims(b, CALLDELIM, BUFDELIM, sizeof CALLDELIM-1);
+        if(getDelimSlices(b, CALLDELIM, sizeof CALLDELIM-1, maxRecs, slices, &nslices) == -1)
+            return reject(REJ_CALLS, b->cur);
+    }
 
-    if(maxRecs > 10)
-        maxRecs = 10;
-    if(getDelimSlices(b, CALLDELIM, sizeof CALLDELIM-1, maxRecs, slices, &nslices) == -1)
-        return -1;
-
+    if(filterOn) {
+        for(i = 0; i < nslices; i++) {
+            if(!filterRec(slices + i, v2))
+                return reject(REJ_FILTER, slices[i].cur);
+        }
+    }
     for(i = 0; i < nslices; i++) {
-        if(parseSysRec(x, i, slices + i, x + i) == -1)
+        if((v2 ? parseSysRec2 : parseSysRec)(x, i, slices + i, x + i) == -1)
             return -1;
     }
     *nRecs = nslices;
@@ -370,8 +774,20 @@ showSysRecArr(struct sysRec *x, int n)
         showSysRec(x + i);
 }
 
-unsigned long
-doSysRec(struct sysRec *x)
+/*
+ * System call executors.  sysExec decides which system calls can be
+ * run and how.  The native one passes OpenBSD system calls straight
+ * to the kernel.
+ */
+#ifdef __OpenBSD__
+static int
+nativeValid(u_int16_t nr)
+{
+    return 1;
+}
+
+static unsigned long
+nativeRun(struct sysRec *x)
 {
 #ifndef USE_INDIR
     return __syscall(x->nr, x->args[0], x->args[1], x->args[2], x->args[3], x->args[4], x->args[5], x->args[6]);
@@ -400,6 +816,55 @@ doSysRec(struct sysRec *x)
 #endif
 }
 
+struct sysExec nativeExec = { "native", nativeValid, nativeRun };
+struct sysExec *sysExec = &nativeExec;
+#endif
+
+/* on linux, OpenBSD numbers are translated with the table in systab.c */
+#ifdef __linux__
+static int
+linuxValid(u_int16_t nr)
+{
+    return linuxSysNr(nr) != -1;
+}
+
+static unsigned long
+linuxRun(struct sysRec *x)
+{
+    long nr;
+
+    nr = linuxSysNr(x->nr);
+    if(nr == -1) {
+        errno = ENOSYS;
+        return -1;
+    }
+    /* linux system calls have at most six args */
+    return syscall(nr, x->args[0], x->args[1], x->args[2], x->args[3], x->args[4], x->args[5]);
+}
+
+struct sysExec linuxExec = { "linux", linuxValid, linuxRun };
+struct sysExec *sysExec = &linuxExec;
+#endif
+
+/* return true if every record can be run by sysExec */
+int
+validSysRecArr(struct sysRec *x, int n)
+{
+    int i;
+
+    for(i = 0; i < n; i++) {
+        if(!sysExec->valid(x[i].nr))
+            return 0;
+    }
+    return 1;
+}
+
+unsigned long
+doSysRec(struct sysRec *x)
+{
+    return sysExec->run(x);
+}
+
 unsigned long
 doSysRecArr(struct sysRec *x, int n)
 {
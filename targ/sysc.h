@@ -1,18 +1,83 @@
 
 #define BUFDELIM "\xa5\xc9\x92"
 #define CALLDELIM "\xb7\xe3\xfe"
+/* first byte of a v2 (length-prefixed) input; no v1 syscall number starts with it */
+#define V2MAGIC 0xc2
 
 struct sysRec {
     u_int16_t nr;
     u_int64_t args[7];
 };
 
+#define STUBFD 1000
+#define STUBPID 99999
+extern int sysStubs;
+
+#define NARGTYPES 12
+#define CLOCKHIST 1024
+struct argStat {
+    unsigned long long n, ns, bytes;
+    unsigned int clockHist[CLOCKHIST];  /* clock read ns */
+};
+extern struct argStat argStats[NARGTYPES];
+extern int argStatsOn;
+double argStatClock(int typ);
+
+void initFilePool(int n, char *prefix, int recheck);
+void cleanTmpFiles(void);
+void initChildPool(int n, int suspend);
+void refillChildPool(void);
+/* the driver runs at most this many calls per input */
+#define MAXCALLS 3
+/* slices in a call record: the header and up to six buffers */
+#define NSLICES 7
+
+/* what happened when running one input */
+#define MAXRECS 10
+struct sysResult {
+    int parseOk, filtered, truncated, nrecs, ncalls;
+    int reject;         /* REJ_ reason from done.h */
+    long rejOff;        /* input offset the parser rejected it at */
+    long ret[MAXRECS];
+    int err[MAXRECS];
+};
+
+extern int rejReason;
+extern long rejOff;
 int parseSysRec(struct sysRec *calls, int ncalls, struct slice *b, struct sysRec *x);
+int parseSysRec2(struct sysRec *calls, int ncalls, struct slice *b, struct sysRec *x);
 int parseSysRecArr(struct slice *b, int maxRecs, struct sysRec *x, int *nRecs);
 void showSysRec(struct sysRec *x);
 void showSysRecArr(struct sysRec *x, int n);
+
+struct sysExec {
+    char *name;
+    int (*valid)(u_int16_t nr);
+    unsigned long (*run)(struct sysRec *x);
+};
+extern struct sysExec *sysExec;
+int validSysRecArr(struct sysRec *x, int n);
 unsigned long doSysRec(struct sysRec *x);
 unsigned long doSysRecArr(struct sysRec *x, int n);
 
+#define POOLFD 64
+int poolFd(int fd);
+void initStdFilePool(void);
 int getStdFile(int typ);
 
+/* systab.c */
+int linuxSysNr(int nr);
+
+/* batch.c */
+typedef void (*runFunc)(char *buf, u_long sz, struct sysResult *res);
+int runBatch(char *src, char *outFn, int timeoutMs, runFunc run);
+
+/* filter.c */
+extern int filterOn;
+int filterAdd(char *spec);
+int filterCall(u_int16_t nr);
+
+/* valid.c */
+extern size_t validBufSize;
+int validInput(unsigned char *buf, size_t sz, long *off, int *nrecs);
+size_t validPrefix(unsigned char *buf, size_t sz);
@@ -0,0 +1,586 @@
+// autogenerated by genSysTab.py. DO NOT EDIT !!!!!!
+#include <sys/syscall.h>
+
+#include "drv.h"
+#include "sysc.h"
+
+/* return the Linux number for OpenBSD system call nr, or -1 */
+int linuxSysNr(int nr)
+{
+    switch(nr) {
+#ifdef SYS_exit
+    case 1: return SYS_exit;
+#endif
+#ifdef SYS_fork
+    case 2: return SYS_fork;
+#endif
+#ifdef SYS_read
+    case 3: return SYS_read;
+#endif
+#ifdef SYS_write
+    case 4: return SYS_write;
+#endif
+#ifdef SYS_open
+    case 5: return SYS_open;
+#endif
+#ifdef SYS_close
+    case 6: return SYS_close;
+#endif
+#ifdef SYS_getentropy
+    case 7: return SYS_getentropy;
+#endif
+#ifdef SYS___tfork
+    case 8: return SYS___tfork;
+#endif
+#ifdef SYS_link
+    case 9: return SYS_link;
+#endif
+#ifdef SYS_unlink
+    case 10: return SYS_unlink;
+#endif
+#ifdef SYS_wait4
+    case 11: return SYS_wait4;
+#endif
+#ifdef SYS_chdir
+    case 12: return SYS_chdir;
+#endif
+#ifdef SYS_fchdir
+    case 13: return SYS_fchdir;
+#endif
+#ifdef SYS_mknod
+    case 14: return SYS_mknod;
+#endif
+#ifdef SYS_chmod
+    case 15: return SYS_chmod;
+#endif
+#ifdef SYS_chown
+    case 16: return SYS_chown;
+#endif
+#ifdef SYS_break
+    case 17: return SYS_break;
+#endif
+#ifdef SYS_getdtablecount
+    case 18: return SYS_getdtablecount;
+#endif
+#ifdef SYS_getrusage
+    case 19: return SYS_getrusage;
+#endif
+#ifdef SYS_getpid
+    case 20: return SYS_getpid;
+#endif
+#ifdef SYS_setuid
+    case 23: return SYS_setuid;
+#endif
+#ifdef SYS_getuid
+    case 24: return SYS_getuid;
+#endif
+#ifdef SYS_geteuid
+    case 25: return SYS_geteuid;
+#endif
+#ifdef SYS_recvmsg
+    case 27: return SYS_recvmsg;
+#endif
+#ifdef SYS_sendmsg
+    case 28: return SYS_sendmsg;
+#endif
+#ifdef SYS_recvfrom
+    case 29: return SYS_recvfrom;
+#endif
+#ifdef SYS_accept
+    case 30: return SYS_accept;
+#endif
+#ifdef SYS_getpeername
+    case 31: return SYS_getpeername;
+#endif
+#ifdef SYS_getsockname
+    case 32: return SYS_getsockname;
+#endif
+#ifdef SYS_access
+    case 33: return SYS_access;
+#endif
+#ifdef SYS_chflags
+    case 34: return SYS_chflags;
+#endif
+#ifdef SYS_fchflags
+    case 35: return SYS_fchflags;
+#endif
+#ifdef SYS_sync
+    case 36: return SYS_sync;
+#endif
+#ifdef SYS_stat
+    case 38: return SYS_stat;
+#endif
+#ifdef SYS_getppid
+    case 39: return SYS_getppid;
+#endif
+#ifdef SYS_lstat
+    case 40: return SYS_lstat;
+#endif
+#ifdef SYS_dup
+    case 41: return SYS_dup;
+#endif
+#ifdef SYS_newfstatat
+    case 42: return SYS_newfstatat;
+#endif
+#ifdef SYS_getegid
+    case 43: return SYS_getegid;
+#endif
+#ifdef SYS_profil
+    case 44: return SYS_profil;
+#endif
+#ifdef SYS_ktrace
+    case 45: return SYS_ktrace;
+#endif
+#ifdef SYS_rt_sigaction
+    case 46: return SYS_rt_sigaction;
+#endif
+#ifdef SYS_getgid
+    case 47: return SYS_getgid;
+#endif
+#ifdef SYS_rt_sigprocmask
+    case 48: return SYS_rt_sigprocmask;
+#endif
+#ifdef SYS_getlogin
+    case 49: return SYS_getlogin;
+#endif
+#ifdef SYS_setlogin
+    case 50: return SYS_setlogin;
+#endif
+#ifdef SYS_rt_sigpending
+    case 52: return SYS_rt_sigpending;
+#endif
+#ifdef SYS_fstat
+    case 53: return SYS_fstat;
+#endif
+#ifdef SYS_ioctl
+    case 54: return SYS_ioctl;
+#endif
+#ifdef SYS_revoke
+    case 56: return SYS_revoke;
+#endif
+#ifdef SYS_symlink
+    case 57: return SYS_symlink;
+#endif
+#ifdef SYS_readlink
+    case 58: return SYS_readlink;
+#endif
+#ifdef SYS_umask
+    case 60: return SYS_umask;
+#endif
+#ifdef SYS_chroot
+    case 61: return SYS_chroot;
+#endif
+#ifdef SYS_getfsstat
+    case 62: return SYS_getfsstat;
+#endif
+#ifdef SYS_statfs
+    case 63: return SYS_statfs;
+#endif
+#ifdef SYS_fstatfs
+    case 64: return SYS_fstatfs;
+#endif
+#ifdef SYS_fhstatfs
+    case 65: return SYS_fhstatfs;
+#endif
+#ifdef SYS_gettimeofday
+    case 67: return SYS_gettimeofday;
+#endif
+#ifdef SYS_setitimer
+    case 69: return SYS_setitimer;
+#endif
+#ifdef SYS_getitimer
+    case 70: return SYS_getitimer;
+#endif
+#ifdef SYS_select
+    case 71: return SYS_select;
+#endif
+#ifdef SYS_kevent
+    case 72: return SYS_kevent;
+#endif
+#ifdef SYS_munmap
+    case 73: return SYS_munmap;
+#endif
+#ifdef SYS_mprotect
+    case 74: return SYS_mprotect;
+#endif
+#ifdef SYS_madvise
+    case 75: return SYS_madvise;
+#endif
+#ifdef SYS_utimes
+    case 76: return SYS_utimes;
+#endif
+#ifdef SYS_futimes
+    case 77: return SYS_futimes;
+#endif
+#ifdef SYS_mincore
+    case 78: return SYS_mincore;
+#endif
+#ifdef SYS_getgroups
+    case 79: return SYS_getgroups;
+#endif
+#ifdef SYS_setgroups
+    case 80: return SYS_setgroups;
+#endif
+#ifdef SYS_getpgrp
+    case 81: return SYS_getpgrp;
+#endif
+#ifdef SYS_setpgid
+    case 82: return SYS_setpgid;
+#endif
+#ifdef SYS_sendsyslog
+    case 83: return SYS_sendsyslog;
+#endif
+#ifdef SYS_utimensat
+    case 84: return SYS_utimensat;
+#endif
+#ifdef SYS_futimens
+    case 85: return SYS_futimens;
+#endif
+#ifdef SYS_kbind
+    case 86: return SYS_kbind;
+#endif
+#ifdef SYS_clock_gettime
+    case 87: return SYS_clock_gettime;
+#endif
+#ifdef SYS_clock_getres
+    case 89: return SYS_clock_getres;
+#endif
+#ifdef SYS_dup2
+    case 90: return SYS_dup2;
+#endif
+#ifdef SYS_nanosleep
+    case 91: return SYS_nanosleep;
+#endif
+#ifdef SYS_fcntl
+    case 92: return SYS_fcntl;
+#endif
+#ifdef SYS_accept4
+    case 93: return SYS_accept4;
+#endif
+#ifdef SYS___thrsleep
+    case 94: return SYS___thrsleep;
+#endif
+#ifdef SYS_fsync
+    case 95: return SYS_fsync;
+#endif
+#ifdef SYS_setpriority
+    case 96: return SYS_setpriority;
+#endif
+#ifdef SYS_socket
+    case 97: return SYS_socket;
+#endif
+#ifdef SYS_connect
+    case 98: return SYS_connect;
+#endif
+#ifdef SYS_getdents64
+    case 99: return SYS_getdents64;
+#endif
+#ifdef SYS_getpriority
+    case 100: return SYS_getpriority;
+#endif
+#ifdef SYS_pipe2
+    case 101: return SYS_pipe2;
+#endif
+#ifdef SYS_dup3
+    case 102: return SYS_dup3;
+#endif
+#ifdef SYS_rt_sigreturn
+    case 103: return SYS_rt_sigreturn;
+#endif
+#ifdef SYS_bind
+    case 104: return SYS_bind;
+#endif
+#ifdef SYS_setsockopt
+    case 105: return SYS_setsockopt;
+#endif
+#ifdef SYS_listen
+    case 106: return SYS_listen;
+#endif
+#ifdef SYS_chflagsat
+    case 107: return SYS_chflagsat;
+#endif
+#ifdef SYS_pledge
+    case 108: return SYS_pledge;
+#endif
+#ifdef SYS_ppoll
+    case 109: return SYS_ppoll;
+#endif
+#ifdef SYS_pselect6
+    case 110: return SYS_pselect6;
+#endif
+#ifdef SYS_rt_sigsuspend
+    case 111: return SYS_rt_sigsuspend;
+#endif
+#ifdef SYS_sendsyslog2
+    case 112: return SYS_sendsyslog2;
+#endif
+#ifdef SYS_getsockopt
+    case 118: return SYS_getsockopt;
+#endif
+#ifdef SYS_readv
+    case 120: return SYS_readv;
+#endif
+#ifdef SYS_writev
+    case 121: return SYS_writev;
+#endif
+#ifdef SYS_fchown
+    case 123: return SYS_fchown;
+#endif
+#ifdef SYS_fchmod
+    case 124: return SYS_fchmod;
+#endif
+#ifdef SYS_setreuid
+    case 126: return SYS_setreuid;
+#endif
+#ifdef SYS_setregid
+    case 127: return SYS_setregid;
+#endif
+#ifdef SYS_rename
+    case 128: return SYS_rename;
+#endif
+#ifdef SYS_flock
+    case 131: return SYS_flock;
+#endif
+#ifdef SYS_mkfifo
+    case 132: return SYS_mkfifo;
+#endif
+#ifdef SYS_sendto
+    case 133: return SYS_sendto;
+#endif
+#ifdef SYS_shutdown
+    case 134: return SYS_shutdown;
+#endif
+#ifdef SYS_socketpair
+    case 135: return SYS_socketpair;
+#endif
+#ifdef SYS_mkdir
+    case 136: return SYS_mkdir;
+#endif
+#ifdef SYS_rmdir
+    case 137: return SYS_rmdir;
+#endif
+#ifdef SYS_setsid
+    case 147: return SYS_setsid;
+#endif
+#ifdef SYS_getfh
+    case 161: return SYS_getfh;
+#endif
+#ifdef SYS_sysarch
+    case 165: return SYS_sysarch;
+#endif
+#ifdef SYS_pread
+    case 173: return SYS_pread;
+#endif
+#ifdef SYS_pwrite
+    case 174: return SYS_pwrite;
+#endif
+#ifdef SYS_setgid
+    case 181: return SYS_setgid;
+#endif
+#ifdef SYS_setegid
+    case 182: return SYS_setegid;
+#endif
+#ifdef SYS_seteuid
+    case 183: return SYS_seteuid;
+#endif
+#ifdef SYS_pathconf
+    case 191: return SYS_pathconf;
+#endif
+#ifdef SYS_fpathconf
+    case 192: return SYS_fpathconf;
+#endif
+#ifdef SYS_getrlimit
+    case 194: return SYS_getrlimit;
+#endif
+#ifdef SYS_setrlimit
+    case 195: return SYS_setrlimit;
+#endif
+#ifdef SYS_mmap
+    case 197: return SYS_mmap;
+#endif
+#ifdef SYS___syscall
+    case 198: return SYS___syscall;
+#endif
+#ifdef SYS_lseek
+    case 199: return SYS_lseek;
+#endif
+#ifdef SYS_truncate
+    case 200: return SYS_truncate;
+#endif
+#ifdef SYS_ftruncate
+    case 201: return SYS_ftruncate;
+#endif
+#ifdef SYS_mlock
+    case 203: return SYS_mlock;
+#endif
+#ifdef SYS_munlock
+    case 204: return SYS_munlock;
+#endif
+#ifdef SYS_getpgid
+    case 207: return SYS_getpgid;
+#endif
+#ifdef SYS_utrace
+    case 209: return SYS_utrace;
+#endif
+#ifdef SYS_semget
+    case 221: return SYS_semget;
+#endif
+#ifdef SYS_msgget
+    case 225: return SYS_msgget;
+#endif
+#ifdef SYS_msgsnd
+    case 226: return SYS_msgsnd;
+#endif
+#ifdef SYS_msgrcv
+    case 227: return SYS_msgrcv;
+#endif
+#ifdef SYS_shmat
+    case 228: return SYS_shmat;
+#endif
+#ifdef SYS_shmdt
+    case 230: return SYS_shmdt;
+#endif
+#ifdef SYS_minherit
+    case 250: return SYS_minherit;
+#endif
+#ifdef SYS_issetugid
+    case 253: return SYS_issetugid;
+#endif
+#ifdef SYS_lchown
+    case 254: return SYS_lchown;
+#endif
+#ifdef SYS_getsid
+    case 255: return SYS_getsid;
+#endif
+#ifdef SYS_msync
+    case 256: return SYS_msync;
+#endif
+#ifdef SYS_pipe
+    case 263: return SYS_pipe;
+#endif
+#ifdef SYS_fhopen
+    case 264: return SYS_fhopen;
+#endif
+#ifdef SYS_preadv
+    case 267: return SYS_preadv;
+#endif
+#ifdef SYS_pwritev
+    case 268: return SYS_pwritev;
+#endif
+#ifdef SYS_kqueue
+    case 269: return SYS_kqueue;
+#endif
+#ifdef SYS_mlockall
+    case 271: return SYS_mlockall;
+#endif
+#ifdef SYS_munlockall
+    case 272: return SYS_munlockall;
+#endif
+#ifdef SYS_getresuid
+    case 281: return SYS_getresuid;
+#endif
+#ifdef SYS_setresuid
+    case 282: return SYS_setresuid;
+#endif
+#ifdef SYS_getresgid
+    case 283: return SYS_getresgid;
+#endif
+#ifdef SYS_setresgid
+    case 284: return SYS_setresgid;
+#endif
+#ifdef SYS_mquery
+    case 286: return SYS_mquery;
+#endif
+#ifdef SYS_closefrom
+    case 287: return SYS_closefrom;
+#endif
+#ifdef SYS_sigaltstack
+    case 288: return SYS_sigaltstack;
+#endif
+#ifdef SYS_shmget
+    case 289: return SYS_shmget;
+#endif
+#ifdef SYS_semop
+    case 290: return SYS_semop;
+#endif
+#ifdef SYS_fhstat
+    case 294: return SYS_fhstat;
+#endif
+#ifdef SYS_semctl
+    case 295: return SYS_semctl;
+#endif
+#ifdef SYS_shmctl
+    case 296: return SYS_shmctl;
+#endif
+#ifdef SYS_msgctl
+    case 297: return SYS_msgctl;
+#endif
+#ifdef SYS_sched_yield
+    case 298: return SYS_sched_yield;
+#endif
+#ifdef SYS_gettid
+    case 299: return SYS_gettid;
+#endif
+#ifdef SYS___thrwakeup
+    case 301: return SYS___thrwakeup;
+#endif
+#ifdef SYS___threxit
+    case 302: return SYS___threxit;
+#endif
+#ifdef SYS___thrsigdivert
+    case 303: return SYS___thrsigdivert;
+#endif
+#ifdef SYS_getcwd
+    case 304: return SYS_getcwd;
+#endif
+#ifdef SYS_setrtable
+    case 310: return SYS_setrtable;
+#endif
+#ifdef SYS_getrtable
+    case 311: return SYS_getrtable;
+#endif
+#ifdef SYS_faccessat
+    case 313: return SYS_faccessat;
+#endif
+#ifdef SYS_fchmodat
+    case 314: return SYS_fchmodat;
+#endif
+#ifdef SYS_fchownat
+    case 315: return SYS_fchownat;
+#endif
+#ifdef SYS_linkat
+    case 317: return SYS_linkat;
+#endif
+#ifdef SYS_mkdirat
+    case 318: return SYS_mkdirat;
+#endif
+#ifdef SYS_mkfifoat
+    case 319: return SYS_mkfifoat;
+#endif
+#ifdef SYS_mknodat
+    case 320: return SYS_mknodat;
+#endif
+#ifdef SYS_openat
+    case 321: return SYS_openat;
+#endif
+#ifdef SYS_readlinkat
+    case 322: return SYS_readlinkat;
+#endif
+#ifdef SYS_renameat
+    case 323: return SYS_renameat;
+#endif
+#ifdef SYS_symlinkat
+    case 324: return SYS_symlinkat;
+#endif
+#ifdef SYS_unlinkat
+    case 325: return SYS_unlinkat;
+#endif
+#ifdef SYS___set_tcb
+    case 329: return SYS___set_tcb;
+#endif
+#ifdef SYS___gettcb
+    case 330: return SYS___gettcb;
+#endif
+    default: return -1;
+    }
+}
@@ -0,0 +1,27 @@
+#!/usr/bin/env python2.7
+"""
+Convert v1 (delimited) input files to the v2 (length-prefixed) format.
+usage: v1to2.py indir outdir
+       v1to2.py file...  (converted in place)
+"""
+import os, sys
+from gen import toV2, readFn, writeFn
+
+def conv(src, dst) :
+    writeFn(dst, toV2(readFn(src)))
+
+if __name__ == '__main__' :
+    args = sys.argv[1:]
+    if len(args) == 2 and os.path.isdir(args[0]) :
+        indir, outdir = args
+        if not os.path.isdir(outdir) :
+            os.mkdir(outdir)
+        for fn in sorted(os.listdir(indir)) :
+            if not fn.startswith('.') :
+                conv(os.path.join(indir, fn), os.path.join(outdir, fn))
+    elif args :
+        for fn in args :
+            conv(fn, fn)
+    else :
+        print __doc__.strip()
+        sys.exit(1)
@@ -0,0 +1,121 @@
+/*
+ * Check inputs on the host with the driver's own parser, with files,
+ * StdFiles and child processes stubbed out, so inputs the driver
+ * would reject don't cost a VM exec.
+ *
+ * Used by the validate tool and built as an AFL post-processing
+ * library (make postlib.so):
+ *     AFL_POST_LIBRARY=./postlib.so
+ * The hook passes valid inputs through, cuts invalid ones back to
+ * the longest run of leading calls that parses, and drops the rest.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "drv.h"
+#include "sysc.h"
+
+int verbose = 0;
+
+/* the driver only sees this much of an input (its -B, default 4080) */
+size_t validBufSize = 4096 - 2 * sizeof(u_int64_t);
+
+static int validInited = 0;
+
+static void
+validInit(void)
+{
+    char *p;
+
+    if(validInited)
+        return;
+    validInited = 1;
+    sysStubs = 1;
+    arenaInit(ARENASZ, ARENABUDGET);
+    p = getenv("DRIVER_BUFSZ");
+    if(p && atol(p) > 0)
+        validBufSize = atol(p);
+}
+
+/* REJ_NONE if the driver would accept the input, or why it wouldn't */
+int
+validInput(unsigned char *buf, size_t sz, long *off, int *nrecs)
+{
+    struct sysRec recs[MAXCALLS];
+    struct slice b;
+    int n = 0, rej;
+
+    validInit();
+    if(sz > validBufSize)
+        sz = validBufSize;
+    arenaReset();
+    mkSlice(&b, buf, sz);
+    rej = parseSysRecArr(&b, MAXCALLS, recs, &n) == 0 ? REJ_NONE : rejReason;
+    arenaReset();
+    if(off)
+        *off = rejOff;
+    if(nrecs)
+        *nrecs = n;
+    return rej;
+}
+
+/* find where each of the first max call records ends, in either format */
+static int
+callEnds(unsigned char *buf, size_t sz, size_t *ends, int max)
+{
+    struct slice b, x;
+    unsigned char *p;
+    u_int32_t len;
+    int n = 0;
+
+    mkSlice(&b, buf, sz);
+    if(sz > 0 && buf[0] == V2MAGIC) {
+        b.cur++;
+        while(n < max
+        && getU32(&b, &len) == 0
+        && getSlice(&b, len, &x) == 0)
+            ends[n++] = b.cur - buf;
+    } else {
+        while(n < max && b.cur != b.end) {
+            p = memmem(b.cur, b.end - b.cur, CALLDELIM, sizeof CALLDELIM-1);
+            ends[n++] = (p ? p : b.end) - buf;
+            if(!p)
+                break;
+            b.cur = p + sizeof CALLDELIM-1;
+        }
+    }
+    return n;
+}
+
+/* length of the longest run of leading calls the driver accepts, or 0 */
+size_t
+validPrefix(unsigned char *buf, size_t sz)
+{
+    size_t ends[MAXCALLS];
+    int n;
+
+    validInit();
+    if(sz > validBufSize)
+        sz = validBufSize;
+    for(n = callEnds(buf, sz, ends, MAXCALLS); n > 0; n--) {
+        if(validInput(buf, ends[n - 1], NULL, NULL) == REJ_NONE)
+            return ends[n - 1];
+    }
+    return 0;
+}
+
+/* AFL_POST_LIBRARY hook, returning NULL makes afl skip the input */
+const unsigned char *
+afl_postprocess(const unsigned char *in_buf, unsigned int *len)
+{
+    unsigned char *buf = (unsigned char *)in_buf;
+
+    if(validInput(buf, *len, NULL, NULL) == REJ_NONE)
+        return in_buf;
+    *len = validPrefix(buf, *len);
+    return *len ? in_buf : NULL;
+}
@@ -0,0 +1,269 @@
+/*
+ * Validate a corpus on the host with the driver's parser (see valid.c).
+ *
+ * Every input is classified as valid or by the reason the driver
+ * would reject it, using a worker process per cpu.  Valid inputs
+ * (and with -r, the valid leading calls of invalid ones) can be
+ * copied to a new corpus directory.
+ *
+ * ./validate [-j n] [-B sz] [-f spec]* [-o dir [-r]] [-q] file-or-dir ...
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "drv.h"
+#include "sysc.h"
+
+struct vres {
+    int reject, nrecs, err;
+    long off;
+    size_t keep;        /* bytes copied to the output, 0 if none */
+};
+
+static char **paths;
+static size_t npaths, maxpaths;
+static char *outDir = NULL;
+static int repair = 0;
+static int quiet = 0;
+static char *rejNames[NREJ] = REJNAMES;
+
+static void
+usage(char *prog)
+{
+    printf("usage:  %s [-j n] [-B sz] [-f spec]* [-o dir [-r]] [-q] file-or-dir ...\n", prog);
+    printf("\t\t-B sz\tdriver input buffer size (default %ld)\n", (long)validBufSize);
+    printf("\t\t-f spec\tcall filter, as for the driver. Can be repeated\n");
+    printf("\t\t-j n\tnumber of worker processes (default one per cpu)\n");
+    printf("\t\t-o dir\tcopy valid inputs to dir\n");
+    printf("\t\t-q\tonly print the summary\n");
+    printf("\t\t-r\twith -o, copy the valid leading calls of invalid inputs\n");
+    exit(1);
+}
+
+static int
+cmpName(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+static void
+addPath(char *path)
+{
+    if(npaths == maxpaths) {
+        maxpaths = maxpaths ? maxpaths * 2 : 1024;
+        paths = realloc(paths, maxpaths * sizeof paths[0]);
+        if(!paths) {
+            perror("malloc");
+            exit(1);
+        }
+    }
+    paths[npaths++] = path;
+}
+
+/* add a file, or every file in a directory in sorted order */
+static void
+addArg(char *arg)
+{
+    struct dirent *ent;
+    char fn[1024];
+    size_t start;
+    DIR *d;
+
+    d = opendir(arg);
+    if(!d) {
+        addPath(arg);
+        return;
+    }
+    start = npaths;
+    while((ent = readdir(d)) != NULL) {
+        if(ent->d_name[0] == '.')
+            continue;
+        snprintf(fn, sizeof fn, "%s/%s", arg, ent->d_name);
+        addPath(strdup(fn));
+    }
+    closedir(d);
+    qsort(paths + start, npaths - start, sizeof paths[0], cmpName);
+}
+
+static unsigned char *
+readFile(char *fn, size_t *sz)
+{
+    unsigned char *buf;
+    struct stat st;
+    int fd;
+
+    fd = open(fn, O_RDONLY);
+    if(fd == -1 || fstat(fd, &st) == -1)
+        return NULL;
+    buf = malloc(st.st_size + 1);
+    if(!buf || read(fd, buf, st.st_size) != st.st_size) {
+        free(buf);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    *sz = st.st_size;
+    return buf;
+}
+
+static int
+writeFile(char *fn, unsigned char *buf, size_t sz)
+{
+    int fd, ok;
+
+    fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1)
+        return -1;
+    ok = write(fd, buf, sz) == (ssize_t)sz;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static void
+checkOne(char *path, struct vres *r)
+{
+    unsigned char *buf;
+    char fn[1024], *base;
+    size_t sz;
+
+    buf = readFile(path, &sz);
+    if(!buf) {
+        r->err = errno ? errno : EIO;
+        return;
+    }
+    r->reject = validInput(buf, sz, &r->off, &r->nrecs);
+    if(outDir) {
+        if(r->reject == REJ_NONE)
+            r->keep = sz;
+        else if(repair)
+            r->keep = validPrefix(buf, sz);
+        if(r->keep) {
+            base = strrchr(path, '/');
+            snprintf(fn, sizeof fn, "%s/%s", outDir, base ? base + 1 : path);
+            if(writeFile(fn, buf, r->keep) == -1) {
+                r->err = errno;
+                r->keep = 0;
+            }
+        }
+    }
+    free(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct vres *res;
+    char *prog, *end;
+    size_t i, bufSz;
+    int opt, njobs, w, status;
+    int count[NREJ], nerr = 0, nrepaired = 0;
+    pid_t pid;
+
+    prog = argv[0];
+    njobs = sysconf(_SC_NPROCESSORS_ONLN);
+    while((opt = getopt(argc, argv, "B:f:j:o:qr")) != -1) {
+        switch(opt) {
+        case 'B':
+            bufSz = strtoul(optarg, &end, 0);
+            if(end == optarg || *end != 0 || bufSz < 1 || bufSz > MAXBUFSZ) {
+                printf("bad arg to -B: %s\n", optarg);
+                exit(1);
+            }
+            validBufSize = bufSz;
+            break;
+        case 'f':
+            if(filterAdd(optarg) == -1) {
+                printf("bad arg to -f: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'j':
+            njobs = atoi(optarg);
+            break;
+        case 'o':
+            outDir = optarg;
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        case 'r':
+            repair = 1;
+            break;
+        case '?':
+        default:
+            usage(prog);
+            break;
+        }
+    }
+    if(optind >= argc)
+        usage(prog);
+    if(njobs < 1)
+        njobs = 1;
+    for(; optind < argc; optind++)
+        addArg(argv[optind]);
+    if(outDir && mkdir(outDir, 0755) == -1 && errno != EEXIST) {
+        perror(outDir);
+        exit(1);
+    }
+
+    /* workers take every njobs'th input and record results in shared memory */
+    res = mmap(NULL, (npaths + 1) * sizeof res[0], PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(res == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    for(w = 0; w < njobs; w++) {
+        pid = fork();
+        if(pid == -1) {
+            perror("fork");
+            exit(1);
+        }
+        if(pid == 0) {
+            for(i = w; i < npaths; i += njobs)
+                checkOne(paths[i], &res[i]);
+            _exit(0);
+        }
+    }
+    while(wait(&status) != -1 || errno == EINTR)
+        continue;
+
+    memset(count, 0, sizeof count);
+    for(i = 0; i < npaths; i++) {
+        if(res[i].err) {
+            nerr++;
+            printf("%s\terror=%s\n", paths[i], strerror(res[i].err));
+            continue;
+        }
+        count[res[i].reject]++;
+        if(res[i].reject != REJ_NONE && res[i].keep)
+            nrepaired++;
+        if(quiet)
+            continue;
+        if(res[i].reject == REJ_NONE)
+            printf("%s\tok\tnrecs=%d\n", paths[i], res[i].nrecs);
+        else if(res[i].keep)
+            printf("%s\treject=%s\toff=%ld\trepaired=%ld\n", paths[i], rejNames[res[i].reject], res[i].off, (long)res[i].keep);
+        else
+            printf("%s\treject=%s\toff=%ld\n", paths[i], rejNames[res[i].reject], res[i].off);
+    }
+
+    printf("inputs:    %ld\n", (long)npaths);
+    for(i = 0; i < NREJ; i++) {
+        if(count[i])
+            printf("  %-10s %6d  %5.1f%%\n", i == REJ_NONE ? "ok" : rejNames[i], count[i], 100.0 * count[i] / npaths);
+    }
+    if(nerr)
+        printf("  %-10s %6d\n", "error", nerr);
+    if(outDir)
+        printf("copied:    %d (%d repaired)\n", count[REJ_NONE] + nrepaired, nrepaired);
+    return 0;
+}